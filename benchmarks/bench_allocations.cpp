@@ -0,0 +1,54 @@
+// Count heap allocations performed by the producer thread for each LOG_INFO call
+#include "../include/stdafx.h"
+#include "../include/rtlog/Consumer.hpp"
+#include "../include/rtlog/rtlog.hpp"
+
+#include <cstdlib>
+#include <new>
+
+// Only allocations issued by the measuring thread are counted
+static thread_local bool count_allocations(false);
+static thread_local std::size_t allocations(0);
+
+void* operator new(std::size_t size)
+{
+    if (count_allocations)
+        allocations++;
+    void* p(std::malloc(size ? size : 1));
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+
+int main(int argc, char* argv[])
+{
+    const unsigned int iterations(argc > 1 ? std::atoi(argv[1]) : 1000000);
+
+    auto& logger = rtlog::CLogger::initialize(rtlog::LogLevel::INFO);
+    rtlog::CLogConsumerSingleFile consumer("bench_allocations.log", logger.getQueue(), 10);
+
+    // Warm up: the queue creates the implicit producer on first use
+    for (unsigned int i(0); i < 1000; i++)
+        LOG_INFO("Warm up", i);
+
+    count_allocations = true;
+    auto start(std::chrono::steady_clock::now());
+    for (unsigned int i(0); i < iterations; i++)
+        LOG_INFO("Iteration", i, 'c', static_cast<int64_t>(i) * 3, "done");
+    auto stop(std::chrono::steady_clock::now());
+    count_allocations = false;
+
+    consumer.stop();
+
+    std::cout <<
+        "calls: " << iterations <<
+        " allocations: " << allocations <<
+        " allocations/call: " << static_cast<double>(allocations) / iterations <<
+        " ns/call: " << std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count() / iterations <<
+        std::endl;
+
+    return allocations ? 1 : 0;
+}
@@ -0,0 +1,43 @@
+// Cost of a LOG_INFO call filtered out by the runtime level
+#include "../include/stdafx.h"
+#include "../include/rtlog/Consumer.hpp"
+#include "../include/rtlog/rtlog.hpp"
+
+#include <cstdlib>
+
+static unsigned int evaluations(0);
+
+// Would be evaluated only if the message were enabled
+static unsigned int expensive_argument()
+{
+    return ++evaluations;
+}
+
+int main(int argc, char* argv[])
+{
+    const unsigned int iterations(argc > 1 ? std::atoi(argv[1]) : 10000000);
+
+    auto& logger = rtlog::CLogger::initialize(rtlog::LogLevel::INFO);
+    rtlog::CLogConsumerSingleFile consumer("bench_disabled_level.log", logger.getQueue(), 1000);
+    logger.setLevel(rtlog::LogLevel::CRIT);
+
+    auto start(std::chrono::steady_clock::now());
+    for (unsigned int i(0); i < iterations; i++)
+        LOG_INFO("Disabled", i, expensive_argument());
+    auto stop(std::chrono::steady_clock::now());
+
+    consumer.stop();
+
+    std::cout <<
+#if defined(USE_TIMEPOINT)
+        "USE_TIMEPOINT"
+#else
+        "no timepoint"
+#endif
+        " calls: " << iterations <<
+        " ns/call: " << static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count()) / iterations <<
+        " argument evaluations: " << evaluations <<
+        std::endl;
+
+    return evaluations ? 1 : 0;
+}
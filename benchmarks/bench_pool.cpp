@@ -0,0 +1,70 @@
+// Messages per second with a single consumer and with 1 to 8 formatting workers
+#include "../include/stdafx.h"
+#include "../include/rtlog/ConsumerPool.hpp"
+#include "../include/rtlog/rtlog.hpp"
+
+#include <cstdlib>
+
+struct PoolQueueTraits : public rtlog::ConcurrentQueueTraits
+{
+    static const std::size_t MAX_SUBQUEUE_SIZE = 4096;
+};
+
+using logger_type = rtlog::CLoggerT<rtlog::LoggerTraits, PoolQueueTraits, moodycamel::ConcurrentQueue, rtlog::COverflowBlockT<1000000>>;
+
+template<typename CONSUMER>
+void produce(const char* name, unsigned int workers, CONSUMER& consumer, logger_type& logger, unsigned int threads, unsigned int iterations)
+{
+    auto start(std::chrono::steady_clock::now());
+    std::vector<std::thread> producers;
+    for (unsigned int thread_index(0); thread_index < threads; thread_index++) {
+        producers.emplace_back(
+            [&logger, thread_index, iterations] ()
+            {
+                for (unsigned int i(0); i < iterations; i++)
+                    logger.write(
+                        RTLOG_THREAD_ID(), rtlog::LogLevel::INFO, RTLOG_POSITION(),
+                        "Thread idx", thread_index, i, "some more text to format", static_cast<uint64_t>(i) * 7919, -static_cast<int64_t>(i)
+                    );
+            }
+        );
+    }
+    for (auto& t : producers)
+        t.join();
+    while (logger.getQueue().size_approx() != 0)
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    consumer.stop();
+    auto stop(std::chrono::steady_clock::now());
+    const rtlog::SinkStats stats(consumer.getSinkStats());
+
+    const double seconds(std::chrono::duration<double>(stop - start).count());
+    std::cout <<
+        name << " workers: " << workers <<
+        " msg/s: " << static_cast<uint64_t>(threads * static_cast<double>(iterations) / seconds) <<
+        " MB/s: " << stats.bytes / seconds / 1e6 <<
+        std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    const unsigned int iterations(argc > 1 ? std::atoi(argv[1]) : 200000);
+    const unsigned int threads(8);
+    const auto backoff(rtlog::CBackoff::sleep(std::chrono::microseconds(100)));
+
+    {
+        auto& logger = logger_type::initialize(rtlog::LogLevel::INFO);
+        rtlog::CLogConsumerSingleFileT<rtlog::LoggerTraits, PoolQueueTraits, moodycamel::ConcurrentQueue, rtlog::CFdSink>
+            consumer("bench_pool.log", logger.getQueue(), backoff);
+        produce("single", 1, consumer, logger, threads, iterations);
+        logger_type::destroy();
+    }
+    for (unsigned int workers : {1, 2, 4, 8}) {
+        auto& logger = logger_type::initialize(rtlog::LogLevel::INFO);
+        rtlog::CLogConsumerPoolT<rtlog::LoggerTraits, PoolQueueTraits, moodycamel::ConcurrentQueue, rtlog::CFdSink>
+            consumer("bench_pool.log", logger.getQueue(), workers, backoff);
+        produce("pool  ", workers, consumer, logger, threads, iterations);
+        logger_type::destroy();
+    }
+
+    return 0;
+}
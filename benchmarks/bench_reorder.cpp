@@ -0,0 +1,107 @@
+// Time stamp inversions in the output and throughput without and with the reorder window, single consumer and pool
+#include "../include/stdafx.h"
+#include "../include/rtlog/Consumer.hpp"
+#include "../include/rtlog/ConsumerPool.hpp"
+#include "../include/rtlog/rtlog.hpp"
+
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+struct NoReorderTraits : public rtlog::ConcurrentQueueTraits
+{
+    static const std::size_t MAX_SUBQUEUE_SIZE = 4096;
+};
+struct CountReorderTraits : public NoReorderTraits
+{
+    static const std::size_t REORDER_WINDOW_SIZE = 4096;
+};
+struct TimeReorderTraits : public NoReorderTraits
+{
+    static const std::size_t REORDER_WINDOW_SIZE = 65536;
+    static const std::chrono::microseconds::rep REORDER_WINDOW_US = 1000;
+};
+
+/** Lines whose leading time stamp is older than the previous line's */
+uint64_t inversions(const char* filename)
+{
+    std::ifstream in(filename);
+    std::string line;
+    uint64_t previous(0), count(0);
+    while (std::getline(in, line)) {
+        const uint64_t time(std::strtoull(line.c_str(), nullptr, 10));
+        if (time < previous)
+            count++;
+        previous = time;
+    }
+    return count;
+}
+
+/** WORKERS formatting threads in a CLogConsumerPoolT, a CLogConsumerSingleFileT if 0 */
+template<typename QUEUE_TRAITS, unsigned int WORKERS>
+void run(const char* name, unsigned int threads, unsigned int iterations)
+{
+    using logger_type = rtlog::CLoggerT<rtlog::LoggerTraits, QUEUE_TRAITS, moodycamel::ConcurrentQueue, rtlog::COverflowBlockT<1000000>>;
+    using consumer_type = typename std::conditional<
+        WORKERS == 0,
+        rtlog::CLogConsumerSingleFileT<rtlog::LoggerTraits, QUEUE_TRAITS, moodycamel::ConcurrentQueue, rtlog::CFdSink>,
+        rtlog::CLogConsumerPoolT<rtlog::LoggerTraits, QUEUE_TRAITS, moodycamel::ConcurrentQueue, rtlog::CFdSink>
+    >::type;
+
+    auto& logger = logger_type::initialize(rtlog::LogLevel::INFO);
+    uint64_t late;
+    auto start(std::chrono::steady_clock::now());
+    {
+        const rtlog::CBackoff backoff(rtlog::CBackoff::sleep(std::chrono::microseconds(100)));
+        std::unique_ptr<consumer_type> owner;
+        if constexpr (WORKERS == 0)
+            owner.reset(new consumer_type("bench_reorder.log", logger.getQueue(), backoff));
+        else
+            owner.reset(new consumer_type("bench_reorder.log", logger.getQueue(), WORKERS, backoff));
+        consumer_type& consumer(*owner);
+
+        std::vector<std::thread> producers;
+        for (unsigned int thread_index(0); thread_index < threads; thread_index++) {
+            producers.emplace_back(
+                [&logger, thread_index, iterations] ()
+                {
+                    for (unsigned int i(0); i < iterations; i++)
+                        logger.write(
+                            std::chrono::high_resolution_clock::now(), RTLOG_THREAD_ID(), rtlog::LogLevel::INFO, RTLOG_POSITION(),
+                            "Thread idx", thread_index, i
+                        );
+                }
+            );
+        }
+        for (auto& t : producers)
+            t.join();
+        while (logger.getQueue().size_approx() != 0)
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        consumer.stop();
+        late = consumer.getLateRecords();
+    }
+    auto stop(std::chrono::steady_clock::now());
+    logger_type::destroy();
+
+    const double seconds(std::chrono::duration<double>(stop - start).count());
+    std::cout <<
+        name <<
+        " msg/s: " << static_cast<uint64_t>(threads * static_cast<double>(iterations) / seconds) <<
+        " late: " << late <<
+        " inversions: " << inversions("bench_reorder.log") <<
+        std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    const unsigned int iterations(argc > 1 ? std::atoi(argv[1]) : 100000);
+
+    run<NoReorderTraits, 0>("no reorder      ", 8, iterations);
+    run<CountReorderTraits, 0>("4096 records    ", 8, iterations);
+    run<TimeReorderTraits, 0>("1 ms            ", 8, iterations);
+    run<NoReorderTraits, 4>("pool no reorder ", 8, iterations);
+    run<CountReorderTraits, 4>("pool 4096 lines ", 8, iterations);
+    run<TimeReorderTraits, 4>("pool 1 ms       ", 8, iterations);
+
+    return 0;
+}
@@ -0,0 +1,104 @@
+// Consumer throughput, bytes per system call and page cache footprint of the output sinks, ofstream is the baseline
+#include "../include/stdafx.h"
+#include "../include/rtlog/Consumer.hpp"
+#include "../include/rtlog/rtlog.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <vector>
+
+struct SinkQueueTraits : public rtlog::ConcurrentQueueTraits
+{
+    static const std::size_t MAX_SUBQUEUE_SIZE = 4096;
+};
+
+/** Bytes of filename resident in the page cache */
+uint64_t cached_bytes(const char* filename)
+{
+    const long page(::sysconf(_SC_PAGESIZE));
+    const int fd(::open(filename, O_RDONLY));
+    struct stat st;
+    if (fd < 0 || ::fstat(fd, &st) != 0 || st.st_size == 0) {
+        if (fd >= 0)
+            ::close(fd);
+        return 0;
+    }
+    uint64_t cached(0);
+    void* map(::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0));
+    if (map != MAP_FAILED) {
+        std::vector<unsigned char> resident((st.st_size + page - 1) / page);
+        if (::mincore(map, st.st_size, resident.data()) == 0) {
+            for (unsigned char r : resident)
+                cached += (r & 1) * page;
+        }
+        ::munmap(map, st.st_size);
+    }
+    ::close(fd);
+    return cached;
+}
+
+template<typename SINK>
+void run(const char* name, unsigned int threads, unsigned int iterations)
+{
+    using logger_type = rtlog::CLoggerT<rtlog::LoggerTraits, SinkQueueTraits, moodycamel::ConcurrentQueue, rtlog::COverflowBlockT<1000000>>;
+    using consumer_type = rtlog::CLogConsumerSingleFileT<rtlog::LoggerTraits, SinkQueueTraits, moodycamel::ConcurrentQueue, SINK>;
+
+    auto& logger = logger_type::initialize(rtlog::LogLevel::INFO);
+    consumer_type consumer("bench_sink.log", logger.getQueue(), rtlog::CBackoff::sleep(std::chrono::microseconds(100)));
+
+    auto start(std::chrono::steady_clock::now());
+    std::vector<std::thread> producers;
+    for (unsigned int thread_index(0); thread_index < threads; thread_index++) {
+        producers.emplace_back(
+            [&logger, thread_index, iterations] ()
+            {
+                for (unsigned int i(0); i < iterations; i++)
+                    logger.write(RTLOG_THREAD_ID(), rtlog::LogLevel::INFO, RTLOG_POSITION(), "Thread idx", thread_index, i);
+            }
+        );
+    }
+    for (auto& t : producers)
+        t.join();
+    while (logger.getQueue().size_approx() != 0)
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    consumer.stop();
+    auto stop(std::chrono::steady_clock::now());
+    const rtlog::SinkStats stats(consumer.getSinkStats());
+    const rtlog::BackoffStats idle(consumer.getBackoffStats());
+    logger_type::destroy();
+
+    const double seconds(std::chrono::duration<double>(stop - start).count());
+    std::cout <<
+        name <<
+        " msg/s: " << static_cast<uint64_t>(threads * static_cast<double>(iterations) / seconds) <<
+        " MB: " << stats.bytes / 1e6 <<
+        " syscalls: " << stats.syscalls <<
+        " bytes/syscall: " << stats.bytes_per_syscall() <<
+        " page cache MB: " << cached_bytes("bench_sink.log") / 1e6 <<
+        std::endl;
+    if constexpr (std::is_same<SINK, rtlog::CPipelineSink>::value) {
+        const rtlog::PipelineStats pipeline(consumer.getSink().getPipelineStats());
+        std::cout <<
+            "         format utilization: " << pipeline.format_utilization(idle.spin_ns + idle.yield_ns + idle.sleep_ns) <<
+            " io utilization: " << pipeline.io_utilization() <<
+            std::endl;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    const unsigned int iterations(argc > 1 ? std::atoi(argv[1]) : 200000);
+
+    run<rtlog::CStreamSink>("ofstream", 4, iterations);
+    run<rtlog::CFdSink>("fd      ", 4, iterations);
+    run<rtlog::CUringSink>("io_uring", 4, iterations);
+    run<rtlog::CPipelineSink>("pipeline", 4, iterations);
+    run<rtlog::CMmapSink>("mmap    ", 4, iterations);
+    run<rtlog::CDirectSink>("O_DIRECT", 4, iterations);
+
+    return 0;
+}
@@ -0,0 +1,47 @@
+// Compare the cost of the RTLOG_THREAD_ID() strategies
+#include "../include/stdafx.h"
+#include "../include/cached_gettid.hpp"
+#include "../include/pthread_gettid_np.hpp"
+
+#include <sys/syscall.h>
+
+#include <cstdlib>
+
+typedef uint64_t (*thread_id_function)();
+
+/** Called through a volatile pointer so that each strategy pays the same call overhead
+ *  and the compiler can't hoist pure functions out of the loop
+ */
+void run(const char* name, unsigned int iterations, thread_id_function function)
+{
+    thread_id_function volatile f(function);
+    uint64_t sum(0);
+    auto start(std::chrono::steady_clock::now());
+    for (unsigned int i(0); i < iterations; i++)
+        sum += f();
+    auto stop(std::chrono::steady_clock::now());
+
+    std::cout <<
+        name <<
+        " ns/call: " << static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count()) / iterations <<
+        " (checksum " << sum << ")" <<
+        std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    const unsigned int iterations(argc > 1 ? std::atoi(argv[1]) : 10000000);
+
+    run("pthread_self()       ", iterations, [] () -> uint64_t { return pthread_self(); });
+    run("syscall(SYS_gettid)  ", iterations, [] () -> uint64_t { return syscall(SYS_gettid); });
+    run("getpid()             ", iterations, [] () -> uint64_t { return getpid(); });
+#if defined(USE_INTERNAL_GETTID)
+    run("pthread_gettid_np()  ", iterations, [] () -> uint64_t { return rtlog::details::pthread_gettid_np(); });
+#else
+    std::cout << "pthread_gettid_np()   not built, define USE_INTERNAL_GETTID" << std::endl;
+#endif
+    run("cached_gettid()      ", iterations, [] () -> uint64_t { return rtlog::details::cached_gettid(); });
+
+    // Make sure the cached value is right
+    return rtlog::details::cached_gettid() == syscall(SYS_gettid) ? 0 : 1;
+}
@@ -0,0 +1,67 @@
+// Messages per second through the consumer with single and bulk dequeue, 8 to 64 producer threads
+#include "../include/stdafx.h"
+#include "../include/rtlog/Consumer.hpp"
+#include "../include/rtlog/rtlog.hpp"
+
+#include <cstdlib>
+
+struct SingleQueueTraits : public rtlog::ConcurrentQueueTraits
+{
+    static const std::size_t MAX_SUBQUEUE_SIZE = 1024;
+    static const std::size_t CONSUMER_BATCH_SIZE = 1;
+};
+struct BulkQueueTraits : public SingleQueueTraits
+{
+    static const std::size_t CONSUMER_BATCH_SIZE = 64;
+};
+
+template<typename QUEUE_TRAITS, template<typename, typename> class QUEUE = moodycamel::ConcurrentQueue>
+void run(const char* name, unsigned int threads, unsigned int iterations)
+{
+    // Producers wait for room so that every message goes through the consumer
+    using logger_type = rtlog::CLoggerT<rtlog::LoggerTraits, QUEUE_TRAITS, QUEUE, rtlog::COverflowBlockT<1000000>>;
+    using consumer_type = rtlog::CLogConsumerSingleFileT<rtlog::LoggerTraits, QUEUE_TRAITS, QUEUE>;
+
+    auto& logger = logger_type::initialize(rtlog::LogLevel::INFO);
+    consumer_type consumer("/dev/null", logger.getQueue(), rtlog::CBackoff::sleep(std::chrono::microseconds(100)));
+
+    auto start(std::chrono::steady_clock::now());
+    std::vector<std::thread> producers;
+    for (unsigned int thread_index(0); thread_index < threads; thread_index++) {
+        producers.emplace_back(
+            [&logger, thread_index, iterations] ()
+            {
+                for (unsigned int i(0); i < iterations; i++)
+                    logger.write(RTLOG_THREAD_ID(), rtlog::LogLevel::INFO, RTLOG_POSITION(), "Thread idx", thread_index, i);
+            }
+        );
+    }
+    for (auto& t : producers)
+        t.join();
+    while (logger.getQueue().size_approx() != 0)
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    auto stop(std::chrono::steady_clock::now());
+    const uint64_t dropped(logger.getDrops().total());
+    consumer.stop();
+    logger_type::destroy();
+
+    const double seconds(std::chrono::duration<double>(stop - start).count());
+    std::cout <<
+        name << " threads: " << threads <<
+        " msg/s: " << static_cast<uint64_t>(threads * static_cast<double>(iterations) / seconds) <<
+        " dropped: " << dropped <<
+        std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    const unsigned int iterations(argc > 1 ? std::atoi(argv[1]) : 20000);
+
+    for (unsigned int threads : {8, 16, 32, 64}) {
+        run<SingleQueueTraits>("single", threads, iterations);
+        run<BulkQueueTraits>("bulk  ", threads, iterations);
+        run<BulkQueueTraits, rtlog::CRingQueueT>("ring  ", threads, iterations);
+    }
+
+    return 0;
+}
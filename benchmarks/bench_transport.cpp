@@ -0,0 +1,62 @@
+// Compare moodycamel::ConcurrentQueue and per thread SPSC rings as CLoggerT transport
+#include "../include/stdafx.h"
+#include "../include/rtlog/Consumer.hpp"
+#include "../include/rtlog/rtlog.hpp"
+
+#include <cstdlib>
+
+struct BenchQueueTraits : public rtlog::ConcurrentQueueTraits
+{
+    static const std::size_t MAX_SUBQUEUE_SIZE = 1024;
+};
+
+template<template<typename, typename> class QUEUE>
+void run(const char* name, unsigned int threads, unsigned int iterations)
+{
+    using logger_type = rtlog::CLoggerT<rtlog::LoggerTraits, BenchQueueTraits, QUEUE>;
+    using consumer_type = rtlog::CLogConsumerSingleFileT<rtlog::LoggerTraits, BenchQueueTraits, QUEUE>;
+
+    auto& logger = logger_type::initialize(rtlog::LogLevel::INFO);
+    consumer_type consumer("/dev/null", logger.getQueue(), 10);
+
+    std::atomic<uint64_t> elapsed_ns(0), failures(0);
+    std::vector<std::thread> producers;
+    for (unsigned int thread_index(0); thread_index < threads; thread_index++) {
+        producers.emplace_back(
+            [&logger, &elapsed_ns, &failures, thread_index, iterations] ()
+            {
+                uint64_t failed(0);
+                auto start(std::chrono::steady_clock::now());
+                for (unsigned int i(0); i < iterations; i++) {
+                    if (!logger.write(std::move(RTLOG_THREAD_ID()), rtlog::LogLevel::INFO, RTLOG_POSITION(), "Thread idx", thread_index, i))
+                        failed++;
+                }
+                auto stop(std::chrono::steady_clock::now());
+                elapsed_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count();
+                failures += failed;
+            }
+        );
+    }
+    for (auto& t : producers)
+        t.join();
+    consumer.stop();
+    logger_type::destroy();
+
+    std::cout <<
+        name << " threads: " << threads <<
+        " ns/call: " << elapsed_ns.load() / (static_cast<uint64_t>(threads) * iterations) <<
+        " failed enqueues: " << failures.load() <<
+        std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    const unsigned int iterations(argc > 1 ? std::atoi(argv[1]) : 100000);
+
+    for (unsigned int threads : {1, 4, 16, 64}) {
+        run<moodycamel::ConcurrentQueue>("concurrentqueue", threads, iterations);
+        run<rtlog::CRingQueueT>("spsc rings     ", threads, iterations);
+    }
+
+    return 0;
+}
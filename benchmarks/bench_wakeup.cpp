@@ -0,0 +1,87 @@
+// Consumer idle CPU time and delivery latency: polling, producer notification and backoff strategies
+#include "../include/stdafx.h"
+#include "../include/rtlog/Consumer.hpp"
+#include "../include/rtlog/rtlog.hpp"
+
+#include <sys/stat.h>
+#include <time.h>
+
+#include <algorithm>
+#include <cstdlib>
+
+struct NotifyQueueTraits : public rtlog::ConcurrentQueueTraits
+{
+    static const bool NOTIFY_CONSUMER = true;
+};
+
+static double process_cpu_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static off_t file_size(const char* filename)
+{
+    struct stat st;
+    return stat(filename, &st) == 0 ? st.st_size : 0;
+}
+
+template<typename QUEUE_TRAITS>
+void run(const char* name, const rtlog::CBackoff& backoff, unsigned int samples)
+{
+    using logger_type = rtlog::CLoggerT<rtlog::LoggerTraits, QUEUE_TRAITS>;
+    using consumer_type = rtlog::CLogConsumerSingleFileT<rtlog::LoggerTraits, QUEUE_TRAITS>;
+    const char* filename("bench_wakeup.log");
+
+    auto& logger = logger_type::initialize(rtlog::LogLevel::INFO);
+    consumer_type consumer(filename, logger.getQueue(), backoff);
+
+    // Idle: nothing to log for a second
+    const double cpu_start(process_cpu_ms());
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    const double idle_cpu(process_cpu_ms() - cpu_start);
+
+    // Latency: time until a single message reaches the file, spaced so that the consumer goes idle
+    std::vector<uint64_t> latencies;
+    for (unsigned int i(0); i < samples; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        const off_t size(file_size(filename));
+        auto start(std::chrono::steady_clock::now());
+        logger.write(RTLOG_THREAD_ID(), rtlog::LogLevel::INFO, RTLOG_POSITION(), "Sample", i);
+        while (file_size(filename) == size)
+            std::this_thread::yield();
+        latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    }
+    const uint64_t wakeups(logger.getQueue().notifier().wakeups());
+    const rtlog::BackoffStats stats(consumer.getBackoffStats());
+    consumer.stop();
+    logger_type::destroy();
+
+    std::sort(latencies.begin(), latencies.end());
+    std::cout <<
+        name <<
+        " idle cpu ms/s: " << idle_cpu <<
+        " median latency us: " << latencies[latencies.size() / 2] / 1000.0 <<
+        " p99 latency us: " << latencies[latencies.size() * 99 / 100] / 1000.0 <<
+        " wakeups: " << wakeups <<
+        " spin/yield/sleep ms: " << stats.spin_ns / 1e6 << "/" << stats.yield_ns / 1e6 << "/" << stats.sleep_ns / 1e6 <<
+        std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    const unsigned int samples(argc > 1 ? std::atoi(argv[1]) : 200);
+
+    for (unsigned int poll_interval_us : {100, 1000}) {
+        const std::chrono::microseconds interval(poll_interval_us);
+        std::cout << "poll interval us: " << poll_interval_us << std::endl;
+        run<rtlog::ConcurrentQueueTraits>("poll  ", rtlog::CBackoff::interval(interval), samples);
+        run<NotifyQueueTraits>("notify", rtlog::CBackoff::interval(interval, std::chrono::milliseconds(100)), samples);
+        run<NotifyQueueTraits>("grow  ", rtlog::CBackoff(0, 0, interval, std::chrono::milliseconds(100)), samples);
+    }
+    run<rtlog::ConcurrentQueueTraits>("spin  ", rtlog::CBackoff::spin(), samples);
+    run<rtlog::ConcurrentQueueTraits>("batch ", rtlog::CBackoff::batch(), samples);
+
+    return 0;
+}
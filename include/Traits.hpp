@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <chrono>
+
 #include "concurrentqueue.h"
 #include "rtlog/Levels.hpp"
 
@@ -14,6 +16,28 @@ struct ConcurrentQueueTraits : public moodycamel::ConcurrentQueueDefaultTraits
 {
     static const std::size_t BLOCK_SIZE = 32;
     static const std::size_t MAX_SUBQUEUE_SIZE = 64;
+    /** Number of producer threads the queue preallocates blocks for */
+    static const std::size_t MAX_PRODUCERS = 64;
+    /** Enqueue through a per-thread ProducerToken instead of the implicit producer lookup */
+    static const bool USE_PRODUCER_TOKEN = true;
+    /** Maximum number of records the consumer dequeues at once */
+    static const std::size_t CONSUMER_BATCH_SIZE = 32;
+    /** Batches the consumer writes before checking stop(), drops and the TSC calibration interval again,
+     *  bounds their latency under sustained load
+     */
+    static const std::size_t CONSUMER_MAX_BATCHES = 64;
+    /** Producers wake up the idle consumer instead of the consumer polling every poll interval */
+    static const bool NOTIFY_CONSUMER = false;
+    /** Longest consumer sleep when NOTIFY_CONSUMER is set and the consumer is given a poll interval,
+     *  bounds TSC recalibration and stop() latency
+     */
+    static const std::chrono::milliseconds::rep CONSUMER_IDLE_TIMEOUT_MS = 100;
+    /** Records held by the consumer to write them in time stamp order (see USE_TIMEPOINT), 0 disables reordering.
+     *  CLogConsumerPoolT holds copies of the formatted lines instead of the records
+     */
+    static const std::size_t REORDER_WINDOW_SIZE = 0;
+    /** Records are held until the newest one is this much younger, 0 to bound the window by REORDER_WINDOW_SIZE only */
+    static const std::chrono::microseconds::rep REORDER_WINDOW_US = 0;
 };
 
 /** Configuration parameters for the logger itself */
@@ -21,10 +45,26 @@ struct LoggerTraits
 {
     /** Number of available parameters in RTLOG_ macros */
     constexpr static std::size_t PARAM_SIZE = 16;
+    /** Encode messages as variable length packed records instead of fixed Argument arrays */
+#if defined(USE_PACKED_RECORD) || defined(USE_SITE_REGISTRY)
+    constexpr static bool PACKED_RECORD = true;
+#else
+    constexpr static bool PACKED_RECORD = false;
+#endif
+    /** Packed record size in bytes, header included; replaces PARAM_SIZE as the message limit */
+    constexpr static std::size_t RECORD_SIZE = 256;
     /** Formatting buffer size */
     constexpr static std::size_t BUFFER_SIZE = 1024;
+    /** Dynamic strings longer than this are truncated, packed records only */
+    constexpr static std::size_t MAX_STRING_LENGTH = 128;
+    /** Maximum number of distinct log statements in the site registry */
+    constexpr static std::size_t MAX_LOG_SITES = 4096;
+    /** Interval between tsc_clock recalibrations done by the consumer, with USE_TSC_CLOCK */
+    constexpr static std::chrono::milliseconds::rep TSC_CALIBRATION_INTERVAL_MS = 1000;
     /** Default logger level */
     constexpr static LogLevel DEFAULT_LEVEL = LogLevel::INFO;
+    /** Messages below this level are discarded at compile time */
+    constexpr static LogLevel MIN_LEVEL = static_cast<LogLevel>(RTLOG_MIN_LEVEL);
 
     /** Messages character type */
     typedef char CHAR_TYPE;
@@ -0,0 +1,54 @@
+/** \file
+ *
+ */
+
+#pragma once
+
+#if !defined(_GNU_SOURCE)
+#   define _GNU_SOURCE
+#endif
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+
+namespace rtlog {
+namespace details {
+
+/** Thread local storage of the cached thread ID, 0 until the first call on each thread.
+ *  Constant initialized, so no guard is involved when accessing it.
+ */
+inline pid_t& __cached_tid()
+{
+    static thread_local pid_t tid = 0;
+    return tid;
+}
+
+/** A forked child inherits the parent's cache for the forking thread */
+inline void __cached_tid_reset()
+{
+    __cached_tid() = 0;
+}
+
+/** Slow path: one gettid() syscall for each thread lifetime */
+__attribute__((noinline)) inline pid_t __cached_gettid_slow(pid_t& tid)
+{
+    static const int atfork(pthread_atfork(nullptr, nullptr, __cached_tid_reset));
+    (void)atfork;
+    tid = static_cast<pid_t>(syscall(SYS_gettid));
+    return tid;
+}
+
+/** Real thread (LWP) ID, cached in thread local storage after the first call.
+ *  Same result as syscall(SYS_gettid) at the cost of a TLS load, without the pthread_gettid_np() offset hack.
+ */
+inline pid_t cached_gettid(void)
+{
+    pid_t& tid(__cached_tid());
+    if (__builtin_expect(tid != 0, 1))
+        return tid;
+    return __cached_gettid_slow(tid);
+}
+
+}  // namespace details
+}  // namespace rtlog
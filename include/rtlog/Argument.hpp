@@ -4,15 +4,19 @@
 
 #pragma once
 
+#include <cstring>
 #include <cwchar>
 
 #include <array>
 #include <chrono>
-
-#include <boost/any.hpp>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
 
 #include <fmt/format.h>
 
+#include "Clock.hpp"
 #include "../Traits.hpp"
 
 namespace rtlog {
@@ -29,12 +33,19 @@ enum class E_ARG_TYPE : uint8_t
     LOG_INFO_TYPE, LOG_WARN_TYPE, LOG_CRIT_TYPE, LOG_LEVEL_TYPE,
     TIMEPOINT_TYPE,
     END_MARKER_TYPE,
+    SITE_TYPE,
+    TSC_TIMEPOINT_TYPE,
+    STRING_TYPE,
     UNKNOWN_TYPE
 };
 /** Placeholder to specify the end of parameters pack */
 struct _ArrayEndMarker {};
 
-/** C++ type to E_ARG_TYPE enum type trait */
+/** C++ type to E_ARG_TYPE enum type trait.
+ *  const char arrays are assumed to be string literals and only their pointer is saved (C_STR_TYPE),
+ *  as for const char*. Mutable char buffers and std::string/std::string_view are copied into the record
+ *  by value (STRING_TYPE), up to LOGGER_TRAITS::MAX_STRING_LENGTH chars.
+ */
 template<typename T, int N = 0> struct ArgType;
 template<> struct ArgType<std::nullptr_t, 0> { constexpr static E_ARG_TYPE ARG_TYPE = E_ARG_TYPE::NULL_TYPE; };
 template<> struct ArgType<int8_t, 0> { static constexpr E_ARG_TYPE ARG_TYPE = E_ARG_TYPE::INT8_TYPE; };
@@ -47,18 +58,32 @@ template<> struct ArgType<int64_t, 0> { static constexpr E_ARG_TYPE ARG_TYPE = E
 template<> struct ArgType<uint64_t, 0> { static constexpr E_ARG_TYPE ARG_TYPE = E_ARG_TYPE::UINT64_TYPE; };
 template<int N> struct ArgType<const char (&)[N]> { static constexpr E_ARG_TYPE ARG_TYPE = E_ARG_TYPE::C_STR_TYPE; };
 template<int N> struct ArgType<const char [N]> { static constexpr E_ARG_TYPE ARG_TYPE = E_ARG_TYPE::C_STR_TYPE; };
-template<int N> struct ArgType<char [N]> { static constexpr E_ARG_TYPE ARG_TYPE = E_ARG_TYPE::C_STR_TYPE; };
+template<int N> struct ArgType<char [N]> { static constexpr E_ARG_TYPE ARG_TYPE = E_ARG_TYPE::STRING_TYPE; };
 template<> struct ArgType<const char*> { static constexpr E_ARG_TYPE ARG_TYPE = E_ARG_TYPE::C_STR_TYPE; };
+template<> struct ArgType<char*> { static constexpr E_ARG_TYPE ARG_TYPE = E_ARG_TYPE::STRING_TYPE; };
+template<> struct ArgType<std::string, 0> { static constexpr E_ARG_TYPE ARG_TYPE = E_ARG_TYPE::STRING_TYPE; };
+template<> struct ArgType<std::string_view, 0> { static constexpr E_ARG_TYPE ARG_TYPE = E_ARG_TYPE::STRING_TYPE; };
 template<> struct ArgType<char, 0> { static constexpr E_ARG_TYPE ARG_TYPE = E_ARG_TYPE::CHAR_TYPE; };
 template<> struct ArgType<LogLevel, 0> { static constexpr E_ARG_TYPE ARG_TYPE = E_ARG_TYPE::LOG_LEVEL_TYPE; };
 template<> struct ArgType<LogInfoType, 0> { static constexpr E_ARG_TYPE ARG_TYPE = E_ARG_TYPE::LOG_INFO_TYPE; };
 template<> struct ArgType<LogWarnType, 0> { static constexpr E_ARG_TYPE ARG_TYPE = E_ARG_TYPE::LOG_WARN_TYPE; };
 template<> struct ArgType<LogCritType, 0> { static constexpr E_ARG_TYPE ARG_TYPE = E_ARG_TYPE::LOG_CRIT_TYPE; };
 template<> struct ArgType<std::chrono::time_point<std::chrono::high_resolution_clock>, 0> { static constexpr E_ARG_TYPE ARG_TYPE = E_ARG_TYPE::TIMEPOINT_TYPE; };
+template<> struct ArgType<rtlog::tsc_clock::time_point, 0> { static constexpr E_ARG_TYPE ARG_TYPE = E_ARG_TYPE::TSC_TIMEPOINT_TYPE; };
 //~ template<> struct ArgType<std::chrono::time_point<std::chrono::system_clock>, 0> { static constexpr E_ARG_TYPE ARG_TYPE = E_ARG_TYPE::TIMEPOINT_TYPE; };
 //~ template<> struct ArgType<std::chrono::time_point<std::chrono::steady_clock>, 0> { static constexpr E_ARG_TYPE ARG_TYPE = E_ARG_TYPE::TIMEPOINT_TYPE; };
 template<> struct ArgType<rtlog::_ArrayEndMarker, 0> { static constexpr E_ARG_TYPE ARG_TYPE = E_ARG_TYPE::END_MARKER_TYPE; };
 
+/** ArgType of a deduced argument type: references and cv-qualifiers are dropped, except the const of
+ *  char arrays, which std::remove_cv strips too and would turn string literals into copied buffers.
+ */
+template<typename T>
+using ArgTypeOf = ArgType<typename std::conditional<
+    std::is_array<typename std::remove_reference<T>::type>::value,
+    typename std::remove_reference<T>::type,
+    typename std::remove_cv<typename std::remove_reference<T>::type>::type
+>::type>;
+
 
 /** E_ARG_TYPE enum to C++ type type trait */
 template<E_ARG_TYPE T> struct TypeArg;
@@ -76,54 +101,136 @@ template<> struct TypeArg<E_ARG_TYPE::CHAR_TYPE> { typedef char TYPE; };
 template<> struct TypeArg<E_ARG_TYPE::LOG_LEVEL_TYPE> { typedef LogLevel TYPE; };
 template<> struct TypeArg<E_ARG_TYPE::TIMEPOINT_TYPE> { typedef std::chrono::time_point<std::chrono::high_resolution_clock> TYPE; };
 template<> struct TypeArg<E_ARG_TYPE::END_MARKER_TYPE> { typedef _ArrayEndMarker TYPE; };
+template<> struct TypeArg<E_ARG_TYPE::SITE_TYPE> { typedef uint32_t TYPE; };
+template<> struct TypeArg<E_ARG_TYPE::TSC_TIMEPOINT_TYPE> { typedef rtlog::tsc_clock::time_point TYPE; };
+/** Points to the length prefixed copy inside the record */
+template<> struct TypeArg<E_ARG_TYPE::STRING_TYPE> { typedef const char* TYPE; };
+
+/** Length prefix of the strings copied by value */
+typedef uint16_t string_size_type;
+
+/** Pointer and length, at most max_length, of a string to be copied by value */
+inline std::pair<const char*, std::size_t> string_ref(const std::string& s, std::size_t max_length) noexcept
+{ return {s.data(), s.size() < max_length ? s.size() : max_length}; }
+inline std::pair<const char*, std::size_t> string_ref(std::string_view s, std::size_t max_length) noexcept
+{ return {s.data(), s.size() < max_length ? s.size() : max_length}; }
+inline std::pair<const char*, std::size_t> string_ref(const char* s, std::size_t max_length) noexcept
+{ return {s, s ? strnlen(s, max_length) : 0}; }
+
+/** Size in bytes of the raw payload of each E_ARG_TYPE */
+constexpr std::size_t arg_size(E_ARG_TYPE t)
+{
+    switch (t) {
+        case E_ARG_TYPE::INT64_TYPE: return sizeof(TypeArg<E_ARG_TYPE::INT64_TYPE>::TYPE);
+        case E_ARG_TYPE::UINT64_TYPE: return sizeof(TypeArg<E_ARG_TYPE::UINT64_TYPE>::TYPE);
+        case E_ARG_TYPE::INT32_TYPE: return sizeof(TypeArg<E_ARG_TYPE::INT32_TYPE>::TYPE);
+        case E_ARG_TYPE::UINT32_TYPE: return sizeof(TypeArg<E_ARG_TYPE::UINT32_TYPE>::TYPE);
+        case E_ARG_TYPE::INT16_TYPE: return sizeof(TypeArg<E_ARG_TYPE::INT16_TYPE>::TYPE);
+        case E_ARG_TYPE::UINT16_TYPE: return sizeof(TypeArg<E_ARG_TYPE::UINT16_TYPE>::TYPE);
+        case E_ARG_TYPE::INT8_TYPE: return sizeof(TypeArg<E_ARG_TYPE::INT8_TYPE>::TYPE);
+        case E_ARG_TYPE::UINT8_TYPE: return sizeof(TypeArg<E_ARG_TYPE::UINT8_TYPE>::TYPE);
+        case E_ARG_TYPE::C_STR_TYPE: return sizeof(TypeArg<E_ARG_TYPE::C_STR_TYPE>::TYPE);
+        case E_ARG_TYPE::CHAR_TYPE: return sizeof(TypeArg<E_ARG_TYPE::CHAR_TYPE>::TYPE);
+        case E_ARG_TYPE::LOG_LEVEL_TYPE: return sizeof(TypeArg<E_ARG_TYPE::LOG_LEVEL_TYPE>::TYPE);
+        case E_ARG_TYPE::TIMEPOINT_TYPE: return sizeof(TypeArg<E_ARG_TYPE::TIMEPOINT_TYPE>::TYPE);
+        case E_ARG_TYPE::SITE_TYPE: return sizeof(TypeArg<E_ARG_TYPE::SITE_TYPE>::TYPE);
+        case E_ARG_TYPE::TSC_TIMEPOINT_TYPE: return sizeof(TypeArg<E_ARG_TYPE::TSC_TIMEPOINT_TYPE>::TYPE);
+        case E_ARG_TYPE::STRING_TYPE: return sizeof(string_size_type);  // Length prefix only, chars follow
+        default: return 0;  // No payload, the type tag is enough
+    }
+}
 
 // Forward declarations
 class Argument;
 template<typename T> fmt::BasicWriter<T>& operator<<(fmt::BasicWriter<T>&, Argument const&);
 
-/** Efficiently store an arbitrary argument as boost::any and save the type for later usage.
+/** Efficiently store an argument inline and save the type for later usage.
+ *  Every TypeArg<> payload fits the fixed storage so no memory allocation ever takes place,
+ *  the whole object is trivially copyable and can be moved around by the queue with a plain copy.
  *  Supports stream insertion based on saved type.
- *  TODO: use boost::any directly
  */
-class Argument : public boost::any
+class Argument
 {
+public:
+    /** Inline payload size, large enough for any supported type */
+    constexpr static std::size_t STORAGE_SIZE = sizeof(uint64_t);
+
 protected:
+    alignas(uint64_t) unsigned char m_Storage[STORAGE_SIZE];
     E_ARG_TYPE m_Type;
 
-public:
-    Argument() : boost::any(), m_Type(E_ARG_TYPE::NULL_TYPE) {}
     template<typename ValueType>
-    Argument(ValueType&& v) :
-        boost::any(std::move(v)),
-        m_Type(ArgType<typename std::remove_cv<typename std::remove_reference<ValueType>::type>::type>::ARG_TYPE)
-    {}
+    using arg_type = ArgTypeOf<ValueType>;
+    template<typename ValueType>
+    using enable_if_value = typename std::enable_if<
+        !std::is_same<typename std::decay<ValueType>::type, Argument>::value
+    >::type;
+
+    template<typename ValueType>
+    inline void assign(ValueType&& v) noexcept
+    {
+        constexpr E_ARG_TYPE ARG_TYPE = arg_type<ValueType>::ARG_TYPE;
+        // Decay arrays to pointers and so on
+        const typename TypeArg<ARG_TYPE>::TYPE value(v);
+        static_assert(sizeof(value) <= STORAGE_SIZE, "Argument type too large for inline storage");
+        static_assert(std::is_trivially_copyable<decltype(value)>::value, "Argument type must be trivially copyable");
+        std::memcpy(m_Storage, &value, sizeof(value));
+        m_Type = ARG_TYPE;
+    }
+
+public:
+    Argument() noexcept : m_Type(E_ARG_TYPE::NULL_TYPE) {}
+    template<typename ValueType, typename = enable_if_value<ValueType>>
+    Argument(ValueType&& v) noexcept
+    { assign(std::forward<ValueType>(v)); }
 
-    template<typename ValueType> Argument& operator=(ValueType&& v)
+    template<typename ValueType, typename = enable_if_value<ValueType>>
+    Argument& operator=(ValueType&& v) noexcept
     {
-        m_Type = ArgType<
-            typename std::remove_cv<typename std::remove_reference<ValueType>::type>::type
-        >::ARG_TYPE;
-        boost::any(static_cast<ValueType&&>(v)).swap(*this);
+        assign(std::forward<ValueType>(v));
         return *this;
     }
 
-    Argument& swap(Argument& arg)
+    Argument& swap(Argument& arg) noexcept
     {
-        E_ARG_TYPE x(m_Type);
-        m_Type = arg.m_Type;
-        arg.m_Type = x;
-        boost::swap(*this, arg);
+        std::swap(*this, arg);
         return *this;
     }
 
+    /** Assign from a raw payload of arg_size(type) bytes, as saved by a packed record */
+    inline void assign(E_ARG_TYPE type, const void* data) noexcept
+    {
+        std::memcpy(m_Storage, data, arg_size(type));
+        m_Type = type;
+    }
+
+    /** Refer to a length prefixed string copied inside a packed record */
+    inline void assign_string(const char* prefixed) noexcept
+    {
+        std::memcpy(m_Storage, &prefixed, sizeof(prefixed));
+        m_Type = E_ARG_TYPE::STRING_TYPE;
+    }
+
+    /** Retrieve the stored value, no check on the actual type */
+    template<E_ARG_TYPE T>
+    inline typename TypeArg<T>::TYPE get() const noexcept
+    {
+        typename TypeArg<T>::TYPE value;
+        std::memcpy(&value, m_Storage, sizeof(value));
+        return value;
+    }
+
     // TODO: for some reason it does not compile as standard function on gcc 7.2.0
     template<typename T>
     inline static bool is_type(const Argument& arg) { return arg.m_Type == ArgType<T, 0>::ARG_TYPE; }
 
     inline E_ARG_TYPE type() const {return m_Type;}
+    inline bool empty() const {return m_Type == E_ARG_TYPE::NULL_TYPE;}
 
 };  // ~class Argument
 
+static_assert(std::is_trivially_copyable<Argument>::value, "Argument must be trivially copyable");
+
 template<typename Char>
 fmt::BasicWriter<Char>& operator<<(fmt::BasicWriter<Char>& os, Argument const& arg)
 {
@@ -132,37 +239,45 @@ fmt::BasicWriter<Char>& operator<<(fmt::BasicWriter<Char>& os, Argument const& a
         case E_ARG_TYPE::NULL_TYPE:
             return os;
         case E_ARG_TYPE::INT64_TYPE:
-            os << boost::any_cast<TypeArg<E_ARG_TYPE::INT64_TYPE>::TYPE>(arg);
+            os << arg.get<E_ARG_TYPE::INT64_TYPE>();
             break;
         case E_ARG_TYPE::UINT64_TYPE:
-            os << boost::any_cast<TypeArg<E_ARG_TYPE::UINT64_TYPE>::TYPE>(arg);
+            os << arg.get<E_ARG_TYPE::UINT64_TYPE>();
             break;
         case E_ARG_TYPE::INT32_TYPE:
-            os << boost::any_cast<TypeArg<E_ARG_TYPE::INT32_TYPE>::TYPE>(arg);
+            os << arg.get<E_ARG_TYPE::INT32_TYPE>();
             break;
         case E_ARG_TYPE::UINT32_TYPE:
-            os.operator<<(boost::any_cast<TypeArg<E_ARG_TYPE::UINT32_TYPE>::TYPE>(arg));
+            os.operator<<(arg.get<E_ARG_TYPE::UINT32_TYPE>());
             break;
         case E_ARG_TYPE::INT16_TYPE:
-            os.operator<<(boost::any_cast<TypeArg<E_ARG_TYPE::INT16_TYPE>::TYPE>(arg));
+            os.operator<<(arg.get<E_ARG_TYPE::INT16_TYPE>());
             break;
         case E_ARG_TYPE::UINT16_TYPE:
-            os.operator<<(boost::any_cast<TypeArg<E_ARG_TYPE::UINT16_TYPE>::TYPE>(arg));
+            os.operator<<(arg.get<E_ARG_TYPE::UINT16_TYPE>());
             break;
         case E_ARG_TYPE::INT8_TYPE:
-            os.operator<<(boost::any_cast<TypeArg<E_ARG_TYPE::INT8_TYPE>::TYPE>(arg));
+            os.operator<<(arg.get<E_ARG_TYPE::INT8_TYPE>());
             break;
         case E_ARG_TYPE::UINT8_TYPE:
-            os.operator<<(boost::any_cast<TypeArg<E_ARG_TYPE::UINT8_TYPE>::TYPE>(arg));
+            os.operator<<(arg.get<E_ARG_TYPE::UINT8_TYPE>());
             break;
         case E_ARG_TYPE::CHAR_TYPE:
-            os.operator<<(boost::any_cast<TypeArg<E_ARG_TYPE::CHAR_TYPE>::TYPE>(arg));
+            os.operator<<(arg.get<E_ARG_TYPE::CHAR_TYPE>());
             break;
         case E_ARG_TYPE::C_STR_TYPE:
-            os.operator<<(boost::any_cast<TypeArg<E_ARG_TYPE::C_STR_TYPE>::TYPE>(arg));
+            os.operator<<(arg.get<E_ARG_TYPE::C_STR_TYPE>());
+            break;
+        case E_ARG_TYPE::STRING_TYPE:
+            {
+                const char* prefixed(arg.get<E_ARG_TYPE::STRING_TYPE>());
+                string_size_type length;
+                std::memcpy(&length, prefixed, sizeof(length));
+                os.operator<<(fmt::BasicStringRef<Char>(prefixed + sizeof(length), length));
+            }
             break;
         case E_ARG_TYPE::LOG_LEVEL_TYPE:
-            switch (boost::any_cast<TypeArg<E_ARG_TYPE::LOG_LEVEL_TYPE>::TYPE>(arg)) {
+            switch (arg.get<E_ARG_TYPE::LOG_LEVEL_TYPE>()) {
                 case LogLevel::INFO:
                     os.operator<<(LogLevelSignature<LogLevel::INFO>::signature);
                     break;
@@ -178,9 +293,16 @@ fmt::BasicWriter<Char>& operator<<(fmt::BasicWriter<Char>& os, Argument const& a
             // TODO: better/configurable time formatting
             os <<
                 std::chrono::duration_cast<std::chrono::microseconds>(
-                    boost::any_cast<TypeArg<E_ARG_TYPE::TIMEPOINT_TYPE>::TYPE>(arg).time_since_epoch()
+                    arg.get<E_ARG_TYPE::TIMEPOINT_TYPE>().time_since_epoch()
                 ).count();
             break;
+        case E_ARG_TYPE::TSC_TIMEPOINT_TYPE:
+            // Raw ticks, converted with the consumer side calibration
+            os <<
+                CTscCalibration::get().to_ns(
+                    arg.get<E_ARG_TYPE::TSC_TIMEPOINT_TYPE>().time_since_epoch().count()
+                ) / 1000;
+            break;
         case E_ARG_TYPE::END_MARKER_TYPE:
             // End of parameters list: add a newline
             return os << typename std::conditional<std::is_same<Char, wchar_t>::value, wchar_t, char>::type ('\n');
@@ -194,7 +316,36 @@ fmt::BasicWriter<Char>& operator<<(fmt::BasicWriter<Char>& os, Argument const& a
 
 /** Holds a log message split in base components, still to be formatted */
 template<typename LOGGER_TRAITS>
-class ArgumentArrayT : public std::array<Argument, LOGGER_TRAITS::PARAM_SIZE> {};
+class ArgumentArrayT : public std::array<Argument, LOGGER_TRAITS::PARAM_SIZE>
+{
+public:
+    constexpr static std::size_t capacity = LOGGER_TRAITS::PARAM_SIZE;
+
+    /** Number of slots taken by a message made of Args */
+    template<typename... Args>
+    constexpr static std::size_t encoded_size_of() { return sizeof...(Args); }
+    /** Check at compile time that a message made of Args fits */
+    template<typename... Args>
+    constexpr static bool fits() { return encoded_size_of<Args...>() <= capacity; }
+
+    /** Store an argument at position pos and advance it.
+     *  There's no room for a copy of dynamic strings: char buffers are saved as pointers,
+     *  as C_STR_TYPE, and must outlive the formatting.
+     */
+    template<typename T>
+    inline void push(std::size_t& pos, T&& v, std::size_t /* reserve */ = 0) noexcept
+    {
+        if constexpr (ArgTypeOf<T>::ARG_TYPE == E_ARG_TYPE::STRING_TYPE) {
+            static_assert(
+                std::is_convertible<T, const char*>::value,
+                "std::string and std::string_view arguments require packed records, see LoggerTraits::PACKED_RECORD"
+            );
+            (*this)[pos++] = static_cast<const char*>(v);
+        }
+        else
+            (*this)[pos++] = std::forward<T>(v);
+    }
+};
 
 using ArgumentArray = ArgumentArrayT<rtlog::LoggerTraits>;
 
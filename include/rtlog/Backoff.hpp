@@ -0,0 +1,170 @@
+/** \file
+ *  Consumer idle strategy: spin, then yield, then sleep
+ */
+
+#pragma once
+
+#include <sched.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#include "Overflow.hpp"
+
+namespace rtlog {
+
+/** Time spent by the consumer in each idle phase */
+struct BackoffStats
+{
+    uint64_t spins = {};
+    uint64_t spin_ns = {};
+    uint64_t yields = {};
+    uint64_t yield_ns = {};
+    uint64_t sleeps = {};
+    uint64_t sleep_ns = {};
+
+    BackoffStats& operator+=(const BackoffStats& other)
+    {
+        spins += other.spins;
+        spin_ns += other.spin_ns;
+        yields += other.yields;
+        yield_ns += other.yield_ns;
+        sleeps += other.sleeps;
+        sleep_ns += other.sleep_ns;
+        return *this;
+    }
+};
+
+/** Backoff strategy for the consumer thread when the queue is empty.
+ *  Each idle() call after the last reset() moves further along: SPINS busy iterations, then YIELDS
+ *  sched_yield calls, then sleeps starting at min_sleep and doubling up to max_sleep.
+ *  The interval() preset paces the sleeps on a poll interval instead, see there.
+ *  reset() is called when work arrives.
+ *  Only the consumer thread drives it, the phase counters can be read from any thread.
+ */
+class CBackoff
+{
+protected:
+    unsigned int m_Spins;
+    unsigned int m_Yields;
+    std::chrono::microseconds m_MinSleep;
+    std::chrono::microseconds m_MaxSleep;
+    /** Sleep until min_sleep after the previous pass started, see interval() */
+    bool m_Paced;
+    /** Time given to the sleeper after a paced sleep, 0 for none */
+    std::chrono::microseconds m_Wait;
+
+    // Consumer state
+    uint64_t m_Idle;
+    std::chrono::microseconds m_Sleep;
+    std::chrono::steady_clock::time_point m_PassStart;
+
+    // Single writer counters
+    std::atomic<uint64_t> m_Counts[3];
+    std::atomic<uint64_t> m_Nanoseconds[3];
+
+    enum E_PHASE { SPIN, YIELD, SLEEP };
+
+    inline void _account(E_PHASE phase, std::chrono::steady_clock::time_point start)
+    {
+        const auto elapsed(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start));
+        m_Counts[phase].store(m_Counts[phase].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        m_Nanoseconds[phase].store(m_Nanoseconds[phase].load(std::memory_order_relaxed) + elapsed.count(), std::memory_order_relaxed);
+    }
+
+public:
+    CBackoff(
+        unsigned int spins, unsigned int yields,
+        std::chrono::microseconds min_sleep, std::chrono::microseconds max_sleep
+    ) :
+        m_Spins(spins), m_Yields(yields),
+        m_MinSleep(min_sleep), m_MaxSleep(std::max(min_sleep, max_sleep)),
+        m_Paced(false), m_Wait(0),
+        m_Idle(0), m_Sleep(min_sleep), m_PassStart(std::chrono::steady_clock::now())
+    {
+        for (std::size_t i = {}; i < 3; i++) {
+            m_Counts[i].store(0, std::memory_order_relaxed);
+            m_Nanoseconds[i].store(0, std::memory_order_relaxed);
+        }
+    }
+    CBackoff(const CBackoff& other) :
+        CBackoff(other.m_Spins, other.m_Yields, other.m_MinSleep, other.m_MaxSleep)
+    {
+        m_Paced = other.m_Paced;
+        m_Wait = other.m_Wait;
+    }
+
+    /** Fixed sleep after each empty pass */
+    static CBackoff sleep(std::chrono::microseconds interval) { return CBackoff(0, 0, interval, interval); }
+    /** Poll interval: an empty queue is checked again interval after the previous pass started, not after
+     *  it ended. With wait the sleeper is then given that long, e.g. to block on a CConsumerNotifier:
+     *  producers wake the consumer up at most once per interval however busy they are.
+     */
+    static CBackoff interval(std::chrono::microseconds interval, std::chrono::microseconds wait = std::chrono::microseconds(0))
+    {
+        CBackoff backoff(0, 0, interval, interval);
+        backoff.m_Paced = true;
+        backoff.m_Wait = wait;
+        return backoff;
+    }
+    /** Burn a CPU while traffic is flowing, for latency sensitive deployments */
+    static CBackoff spin() { return CBackoff(100000, 1000, std::chrono::microseconds(50), std::chrono::milliseconds(1)); }
+    /** Few wakeups, for throughput oriented deployments */
+    static CBackoff batch() { return CBackoff(0, 10, std::chrono::milliseconds(1), std::chrono::milliseconds(100)); }
+
+    /** Work arrived, start over from the first phase */
+    inline void reset()
+    {
+        m_Idle = 0;
+        m_Sleep = m_MinSleep;
+        if (m_Paced)
+            m_PassStart = std::chrono::steady_clock::now();
+    }
+
+    /** The queue was found empty, wait according to the current phase.
+     *  sleep(duration) is called for the sleep phase, e.g. to wait on a CConsumerNotifier instead.
+     */
+    template<typename SLEEPER>
+    void idle(SLEEPER&& sleep)
+    {
+        const auto start(std::chrono::steady_clock::now());
+        if (m_Idle < m_Spins) {
+            cpu_relax();
+            _account(SPIN, start);
+        } else if (m_Idle < static_cast<uint64_t>(m_Spins) + m_Yields) {
+            sched_yield();
+            _account(YIELD, start);
+        } else if (m_Paced) {
+            // Rest of the poll interval only
+            std::this_thread::sleep_until(m_PassStart + m_MinSleep);
+            if (m_Wait.count() > 0)
+                sleep(m_Wait);
+            _account(SLEEP, start);
+        } else {
+            sleep(m_Sleep);
+            m_Sleep = std::min(m_Sleep * 2, m_MaxSleep);
+            _account(SLEEP, start);
+        }
+        m_Idle++;
+        if (m_Paced)
+            m_PassStart = std::chrono::steady_clock::now();
+    }
+    void idle() { idle([] (std::chrono::microseconds d) { std::this_thread::sleep_for(d); }); }
+
+    BackoffStats getStats() const
+    {
+        BackoffStats stats;
+        stats.spins = m_Counts[SPIN].load(std::memory_order_relaxed);
+        stats.spin_ns = m_Nanoseconds[SPIN].load(std::memory_order_relaxed);
+        stats.yields = m_Counts[YIELD].load(std::memory_order_relaxed);
+        stats.yield_ns = m_Nanoseconds[YIELD].load(std::memory_order_relaxed);
+        stats.sleeps = m_Counts[SLEEP].load(std::memory_order_relaxed);
+        stats.sleep_ns = m_Nanoseconds[SLEEP].load(std::memory_order_relaxed);
+        return stats;
+    }
+};
+
+}  // namespace rtlog
@@ -0,0 +1,178 @@
+/** \file
+ *  Raw time stamp counter clock, converted to wall time on the consumer side
+ */
+
+#pragma once
+
+#include <time.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#   include <x86intrin.h>
+#endif
+
+namespace rtlog {
+
+/** Clock returning raw CPU time stamp counter ticks.
+ *  now() is a single instruction on the producer side, ticks are turned into wall time by CTscCalibration
+ *  when formatting. Assumes an invariant TSC, synchronized across cores.
+ *  The tick period is only known at run time, so duration and time_point are not std::chrono types and
+ *  cannot be converted by std::chrono::duration_cast: use CTscCalibration::to_ns() or to_system().
+ */
+struct tsc_clock
+{
+    typedef int64_t rep;
+    constexpr static bool is_steady = true;
+
+    /** Opaque tick count */
+    class duration
+    {
+    protected:
+        rep m_Ticks;
+
+    public:
+        duration() = default;
+        constexpr explicit duration(rep ticks) noexcept : m_Ticks(ticks) {}
+        constexpr rep count() const noexcept { return m_Ticks; }
+    };
+
+    class time_point
+    {
+    protected:
+        duration m_Ticks;
+
+    public:
+        time_point() = default;
+        constexpr explicit time_point(duration ticks) noexcept : m_Ticks(ticks) {}
+        constexpr duration time_since_epoch() const noexcept { return m_Ticks; }
+    };
+
+    static inline rep ticks() noexcept
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return static_cast<rep>(__rdtsc());
+#elif defined(__aarch64__)
+        uint64_t v;
+        asm volatile("mrs %0, cntvct_el0" : "=r" (v));
+        return static_cast<rep>(v);
+#else
+        return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+    }
+
+    static inline time_point now() noexcept { return time_point(duration(ticks())); }
+};
+
+/** Maps tsc_clock ticks to CLOCK_REALTIME nanoseconds.
+ *  Calibrated once at first use and then periodically by the consumer thread through calibrate(),
+ *  which is single writer. Readers use a sequence lock so they can run on any thread.
+ */
+class CTscCalibration
+{
+protected:
+    /** Odd while an update is in progress */
+    std::atomic<uint32_t> m_Sequence;
+    std::atomic<int64_t> m_BaseTicks;
+    std::atomic<int64_t> m_BaseNs;
+    std::atomic<double> m_NsPerTick;
+    /** Last sample, start of the next calibration window */
+    int64_t m_RefTicks;
+    int64_t m_RefNs;
+
+    static int64_t realtime_ns() noexcept
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    /** Take a (ticks, ns) pair, keeping the tightest of a few tries */
+    static void sample(int64_t& ticks, int64_t& ns) noexcept
+    {
+        int64_t best(INT64_MAX);
+        ticks = 0;
+        ns = 0;
+        for (int i = 0; i < 5; i++) {
+            const int64_t t0(tsc_clock::ticks());
+            const int64_t n(realtime_ns());
+            const int64_t t1(tsc_clock::ticks());
+            if (t1 - t0 < best) {
+                best = t1 - t0;
+                ticks = t0 + (t1 - t0) / 2;
+                ns = n;
+            }
+        }
+    }
+
+    void publish(int64_t ticks, int64_t ns, double ns_per_tick) noexcept
+    {
+        const uint32_t seq(m_Sequence.load(std::memory_order_relaxed));
+        m_Sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_BaseTicks.store(ticks, std::memory_order_relaxed);
+        m_BaseNs.store(ns, std::memory_order_relaxed);
+        m_NsPerTick.store(ns_per_tick, std::memory_order_relaxed);
+        m_Sequence.store(seq + 2, std::memory_order_release);
+    }
+
+    CTscCalibration() : m_Sequence(0), m_RefTicks(0), m_RefNs(0)
+    {
+        int64_t ticks(0), ns(0);
+        sample(ticks, ns);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        sample(m_RefTicks, m_RefNs);
+        publish(m_RefTicks, m_RefNs, static_cast<double>(m_RefNs - ns) / (m_RefTicks - ticks));
+    }
+
+public:
+    static CTscCalibration& get()
+    {
+        static CTscCalibration calibration;
+        return calibration;
+    }
+
+    /** Compute the tick rate over the window since the previous calibration and rebase on now */
+    void calibrate() noexcept
+    {
+        int64_t ticks(0), ns(0);
+        sample(ticks, ns);
+        if (ticks <= m_RefTicks)
+            return;
+        publish(ticks, ns, static_cast<double>(ns - m_RefNs) / (ticks - m_RefTicks));
+        m_RefTicks = ticks;
+        m_RefNs = ns;
+    }
+
+    /** Convert ticks to nanoseconds since the epoch */
+    int64_t to_ns(int64_t ticks) const noexcept
+    {
+        uint32_t seq;
+        int64_t base_ticks, base_ns;
+        double ns_per_tick;
+        do {
+            seq = m_Sequence.load(std::memory_order_acquire);
+            base_ticks = m_BaseTicks.load(std::memory_order_relaxed);
+            base_ns = m_BaseNs.load(std::memory_order_relaxed);
+            ns_per_tick = m_NsPerTick.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } while ((seq & 1) || seq != m_Sequence.load(std::memory_order_relaxed));
+
+        return base_ns + static_cast<int64_t>((ticks - base_ticks) * ns_per_tick);
+    }
+
+    /** Convert a tsc_clock time point to the system clock */
+    std::chrono::system_clock::time_point to_system(tsc_clock::time_point tp) const noexcept
+    {
+        return std::chrono::system_clock::time_point(
+            std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                std::chrono::nanoseconds(to_ns(tp.time_since_epoch().count()))
+            )
+        );
+    }
+};
+
+}  // namespace rtlog
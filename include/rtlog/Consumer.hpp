@@ -6,25 +6,50 @@
 
 #include <atomic>
 #include <chrono>
-#include <fstream>
 #include <functional>
+#include <memory>
 #include <thread>
+#include <type_traits>
 
+#include "Backoff.hpp"
+#include "DirectSink.hpp"
+#include "FanOutSink.hpp"
 #include "Formatter.hpp"
+#include "MmapSink.hpp"
+#include "Queue.hpp"
+#include "Record.hpp"
+#include "Reorder.hpp"
+#include "RingQueue.hpp"
+#include "RollingSink.hpp"
+#include "PipelineSink.hpp"
+#include "Sink.hpp"
+#include "Thread.hpp"
+#include "UringSink.hpp"
 #include "../Traits.hpp"
 
 namespace rtlog {
 
 /** Base consumer class */
-template<typename LOGGER_TRAITS, typename QUEUE_TRAITS>
+template<
+    typename LOGGER_TRAITS, typename QUEUE_TRAITS,
+    template<typename, typename> class QUEUE = moodycamel::ConcurrentQueue
+>
 class CLogConsumerBaseT
 {
+public:
+    typedef rtlog::RecordT<LOGGER_TRAITS> record_type;
+    typedef CLogQueueT<QUEUE<record_type, QUEUE_TRAITS>> queue_type;
+    /** Consumer tokens are specific to moodycamel::ConcurrentQueue */
+    constexpr static bool use_consumer_token =
+        std::is_same<typename queue_type::base_queue_type, moodycamel::ConcurrentQueue<record_type, QUEUE_TRAITS>>::value;
+
 protected:
-    moodycamel::ConcurrentQueue<rtlog::ArgumentArrayT<LOGGER_TRAITS>, QUEUE_TRAITS>& m_Queue;
+    queue_type& m_Queue;
     std::atomic_bool m_Stop;
+    /** Drops already reported in the output */
+    DropCount m_ReportedDrops;
 
 public:
-    typedef moodycamel::ConcurrentQueue<rtlog::ArgumentArrayT<LOGGER_TRAITS>, QUEUE_TRAITS> queue_type;
 
     CLogConsumerBaseT(queue_type& queue) :
         m_Queue(queue)
@@ -34,61 +59,253 @@ public:
 
     virtual void consume() = 0;
 
+    /** Check for new drops since the last call, returns false if none */
+    bool newDrops(DropCount& delta)
+    {
+        const DropCount drops(m_Queue.drops().get());
+        if (drops.total() == m_ReportedDrops.total())
+            return false;
+        delta = drops - m_ReportedDrops;
+        m_ReportedDrops = drops;
+        return true;
+    }
+
     void stop()
     {
         m_Stop.store(true);
     }
 };
 
-/** Single file output consumer running in a new thread */
-template<typename LOGGER_TRAITS, typename QUEUE_TRAITS>
-class CLogConsumerSingleFileT : public CLogConsumerBaseT<LOGGER_TRAITS, QUEUE_TRAITS>
+/** Single file output consumer running in a new thread, writing through SINK (see Sink.hpp) */
+template<
+    typename LOGGER_TRAITS, typename QUEUE_TRAITS,
+    template<typename, typename> class QUEUE = moodycamel::ConcurrentQueue,
+    typename SINK = CStreamSink
+>
+class CLogConsumerSingleFileT : public CLogConsumerBaseT<LOGGER_TRAITS, QUEUE_TRAITS, QUEUE>
 {
 protected:
-    std::chrono::microseconds m_PollInterval;
-    rtlog::CFormatter m_Formatter;
-    rtlog::ArgumentArrayT<LOGGER_TRAITS> m_ArgumentArray;
+    CBackoff m_Backoff;
+    rtlog::CFormatterT<LOGGER_TRAITS, QUEUE_TRAITS> m_Formatter;
+    /** Records dequeued at once */
+    std::unique_ptr<rtlog::RecordT<LOGGER_TRAITS>[]> m_Batch;
+    /** Time stamp ordering, with QUEUE_TRAITS::REORDER_WINDOW_SIZE */
+    CReorderWindowT<rtlog::RecordT<LOGGER_TRAITS>> m_Reorder;
+    const ThreadOptions m_ThreadOptions;
+    std::atomic<int> m_ThreadError;
     std::thread m_ConsumerThread;
     std::string m_FileName;
-    std::ofstream m_Stream;
+    SINK m_Sink;
 
 public:
-    typedef CLogConsumerBaseT<LOGGER_TRAITS, QUEUE_TRAITS> base_type;
+    typedef CLogConsumerBaseT<LOGGER_TRAITS, QUEUE_TRAITS, QUEUE> base_type;
     using queue_type = typename base_type::queue_type;
+    constexpr static bool reorder = QUEUE_TRAITS::REORDER_WINDOW_SIZE > 0;
 
+    /** Poll the queue every poll_interval_us, see CBackoff::interval().
+     *  With QUEUE_TRAITS::NOTIFY_CONSUMER the consumer then waits for a producer up to CONSUMER_IDLE_TIMEOUT_MS,
+     *  the poll interval being the minimum time between wakeups.
+     */
     CLogConsumerSingleFileT(const std::string& filename, queue_type& queue, uint32_t poll_interval_us) :
+        CLogConsumerSingleFileT(
+            filename, queue,
+            CBackoff::interval(
+                std::chrono::microseconds(poll_interval_us),
+                QUEUE_TRAITS::NOTIFY_CONSUMER ?
+                    std::chrono::microseconds(std::chrono::milliseconds(QUEUE_TRAITS::CONSUMER_IDLE_TIMEOUT_MS)) :
+                    std::chrono::microseconds(0)
+            )
+        )
+    {}
+    /** Wait according to backoff when the queue is empty, sink_args follow the file name in the SINK constructor */
+    template<typename... SinkArgs>
+    CLogConsumerSingleFileT(const std::string& filename, queue_type& queue, const CBackoff& backoff, SinkArgs&&... sink_args) :
+        CLogConsumerSingleFileT(filename, queue, ThreadOptions(), backoff, std::forward<SinkArgs>(sink_args)...)
+    {}
+    /** Consumer thread with the given affinity, scheduling and name, see getThreadError() */
+    template<typename... SinkArgs>
+    CLogConsumerSingleFileT(
+        const std::string& filename, queue_type& queue, const ThreadOptions& thread_options, const CBackoff& backoff,
+        SinkArgs&&... sink_args
+    ) :
         base_type(queue),
-        m_PollInterval(poll_interval_us), m_FileName(filename),
-        m_Stream(filename, std::ofstream::binary|std::ofstream::trunc|std::ofstream::out)
+        m_Backoff(backoff),
+        m_Batch(new rtlog::RecordT<LOGGER_TRAITS>[QUEUE_TRAITS::CONSUMER_BATCH_SIZE]),
+        m_Reorder(QUEUE_TRAITS::REORDER_WINDOW_SIZE, std::chrono::microseconds(QUEUE_TRAITS::REORDER_WINDOW_US)),
+        m_ThreadOptions(thread_options),
+        m_ThreadError(0),
+        m_FileName(filename),
+        m_Sink(filename, std::forward<SinkArgs>(sink_args)...)
     {
+#if defined(USE_TSC_CLOCK)
+        // Initial calibration, out of the consumer loop
+        CTscCalibration::get();
+#endif
         // Create and start thread
-        m_ConsumerThread = std::thread(std::bind(&CLogConsumerSingleFileT<LOGGER_TRAITS, QUEUE_TRAITS>::consume, this));
+        m_ConsumerThread = std::thread(
+            [this] ()
+            {
+                m_ThreadError.store(apply_thread_options(m_ThreadOptions));
+                consume();
+            }
+        );
     }
 
+    virtual ~CLogConsumerSingleFileT() { stop(); }
+
     virtual void consume()
     {
-        const typename LOGGER_TRAITS::CHAR_TYPE* p;
-        while (!this->m_Stop.load(std::memory_order_acquire)) {
-            while (this->m_Queue.try_dequeue(m_ArgumentArray)) {
-                // Dequeue a log message block
-                // It SHOULD be complete but it's not guaranteed
-                p = m_Formatter.format(m_ArgumentArray);
-                if (p)
-                    m_Stream << p;
-            }
-            m_Stream.flush();
-            // TODO: sleep only for remaining poll interval
-            std::this_thread::sleep_for(m_PollInterval);
+        if constexpr (base_type::use_consumer_token) {
+            moodycamel::ConsumerToken token(this->m_Queue);
+            _consume(
+                [this, &token] ()
+                { return this->m_Queue.try_dequeue_bulk(token, m_Batch.get(), QUEUE_TRAITS::CONSUMER_BATCH_SIZE); }
+            );
         }
-
-        m_Stream.flush();
+        else
+            _consume([this] () { return this->m_Queue.try_dequeue_bulk(m_Batch.get(), QUEUE_TRAITS::CONSUMER_BATCH_SIZE); });
     }
 
+    /** Time spent idle so far, by backoff phase */
+    BackoffStats getBackoffStats() const { return m_Backoff.getStats(); }
+    /** Bytes written and system calls made so far by the sink */
+    SinkStats getSinkStats() const { return m_Sink.getStats(); }
+    /** The sink, for sink specific statistics and controls */
+    SINK& getSink() { return m_Sink; }
+    /** Records written out of time stamp order despite the reorder window */
+    uint64_t getLateRecords() const { return m_Reorder.late(); }
+    /** Error number of the first thread option that could not be applied, 0 if none or not applied yet */
+    int getThreadError() const { return m_ThreadError.load(); }
+
     void stop()
     {
+        if (!m_ConsumerThread.joinable())
+            return;
         this->m_Stop.store(true);
+        this->m_Queue.notifier().wake();
         m_ConsumerThread.join();
-        m_Stream.close();
+        m_Sink.close();
+    }
+
+protected:
+    /** Consumer loop, DEQUEUE fills m_Batch and returns the number of records */
+    template<typename DEQUEUE>
+    void _consume(DEQUEUE&& dequeue)
+    {
+#if defined(USE_TSC_CLOCK)
+        const std::chrono::milliseconds calibration_interval(LOGGER_TRAITS::TSC_CALIBRATION_INTERVAL_MS);
+        auto last_calibration(std::chrono::steady_clock::now());
+#endif
+        while (!this->m_Stop.load(std::memory_order_acquire)) {
+#if defined(USE_TSC_CLOCK)
+            const auto now(std::chrono::steady_clock::now());
+            if (now - last_calibration >= calibration_interval) {
+                CTscCalibration::get().calibrate();
+                last_calibration = now;
+            }
+#endif
+            bool work(false);
+            bool drained(false);
+            for (std::size_t batches = {}; batches < QUEUE_TRAITS::CONSUMER_MAX_BATCHES; batches++) {
+                const std::size_t count(dequeue());
+                if (count == 0) {
+                    drained = true;
+                    break;
+                }
+                // Dequeue a batch of log message blocks
+                // They SHOULD be complete but it's not guaranteed
+                for (std::size_t i = {}; i < count; i++)
+                    _push(m_Batch[i]);
+                if constexpr (reorder)
+                    m_Reorder.pop(_writer());
+                work = true;
+            }
+            if constexpr (reorder) {
+                // Queue drained, release what has been held long enough
+                if (drained && !m_Reorder.empty() && m_Reorder.expire(record_clock_ns(), _writer()))
+                    work = true;
+            }
+            if (_report_drops())
+                work = true;
+            if (work) {
+                m_Sink.flush();
+                m_Backoff.reset();
+            }
+            else if constexpr (QUEUE_TRAITS::NOTIFY_CONSUMER) {
+                // Sleep until a producer enqueues
+                m_Backoff.idle(
+                    [this] (std::chrono::microseconds timeout)
+                    {
+                        this->m_Queue.notifier().wait(
+                            timeout, [this] () { return this->m_Queue.size_approx() == 0 && !this->m_Stop.load(); }
+                        );
+                    }
+                );
+            }
+            else
+                m_Backoff.idle();
+        }
+
+        if constexpr (reorder)
+            m_Reorder.drain(_writer());
+        _report_drops();
+        m_Sink.flush();
+    }
+
+    /** Sink for the records leaving the reorder window */
+    inline auto _writer()
+    {
+        return [this] (rtlog::RecordT<LOGGER_TRAITS>& record) { _write(record); };
+    }
+
+    /** Write a dequeued record, through the reorder window if enabled */
+    inline void _push(rtlog::RecordT<LOGGER_TRAITS>& record)
+    {
+        if constexpr (reorder)
+            m_Reorder.push(record, _writer());
+        else
+            _write(record);
+    }
+
+    /** Format a record to the sink, in place when the sink allows it */
+    inline void _write(rtlog::RecordT<LOGGER_TRAITS>& record)
+    {
+        if constexpr (sink_levels<SINK>::value) {
+            // Records without a level are kept by every sink
+            LogLevel level;
+            if (!record_level(record, level))
+                level = LogLevel::CRIT;
+            if (!m_Sink.accepts(level))
+                return;
+            const typename LOGGER_TRAITS::CHAR_TYPE* p(m_Formatter.format(record));
+            if (p)
+                m_Sink.write(p, m_Formatter.size(), level);
+            return;
+        }
+        if constexpr (SINK::DIRECT) {
+            // Formatting stops at the end of the formatter buffer size, make sure the sink has that much room
+            typename LOGGER_TRAITS::CHAR_TYPE* buffer(m_Sink.reserve(m_Formatter.buffer_size));
+            if (buffer) {
+                const std::size_t size(m_Formatter.format_to(record, buffer));
+                if (size)
+                    m_Sink.commit(size);
+                return;
+            }
+        }
+        const typename LOGGER_TRAITS::CHAR_TYPE* p(m_Formatter.format(record));
+        if (p)
+            m_Sink.write(p, m_Formatter.size());
+    }
+
+    /** Emit a synthetic record when messages have been lost */
+    bool _report_drops()
+    {
+        DropCount delta;
+        if (!this->newDrops(delta))
+            return false;
+        const typename LOGGER_TRAITS::CHAR_TYPE* p(m_Formatter.format_dropped(delta));
+        m_Sink.write(p, m_Formatter.size());
+        return true;
     }
 };
 using CLogConsumerSingleFile = CLogConsumerSingleFileT<rtlog::LoggerTraits, rtlog::ConcurrentQueueTraits>;
@@ -0,0 +1,394 @@
+/** \file
+ *  Consumer with parallel formatting threads and ordered output
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Consumer.hpp"
+#include "Reorder.hpp"
+
+namespace rtlog {
+
+/** Single file output consumer formatting with a pool of worker threads, each with its own formatter.
+ *  A worker dequeues a batch and takes the next ticket under a mutex, so tickets follow the dequeue
+ *  order, then formats the batch into the slot of that ticket, out of the lock.
+ *  Sequencer: formatted slots are written to the sink strictly in ticket order by whichever worker
+ *  manages to take the writer flag, so the output is the same as a single consumer's and the sink
+ *  is only ever used by one thread at a time. A worker waits for its slot only when SLOTS_PER_WORKER
+ *  batches per worker are formatted and not yet written, i.e. when the sink is the bottleneck.
+ *  Time stamp order (USE_TIMEPOINT): without QUEUE_TRAITS::REORDER_WINDOW_SIZE only the records of
+ *  a batch are sorted. With it each slot also keeps the time stamp and position of its lines and
+ *  the sequencer merges them through a CReorderWindowT of formatted lines, the same as the window of
+ *  CLogConsumerSingleFileT, at the cost of a copy of each line.
+ */
+template<
+    typename LOGGER_TRAITS, typename QUEUE_TRAITS,
+    template<typename, typename> class QUEUE = moodycamel::ConcurrentQueue,
+    typename SINK = CStreamSink
+>
+class CLogConsumerPoolT : public CLogConsumerBaseT<LOGGER_TRAITS, QUEUE_TRAITS, QUEUE>
+{
+    static_assert(!sink_levels<SINK>::value, "Slots hold whole batches, level routing requires CLogConsumerSingleFileT");
+
+public:
+    typedef CLogConsumerBaseT<LOGGER_TRAITS, QUEUE_TRAITS, QUEUE> base_type;
+    using queue_type = typename base_type::queue_type;
+    using record_type = typename base_type::record_type;
+    typedef rtlog::CFormatterT<LOGGER_TRAITS, QUEUE_TRAITS> formatter_type;
+    typedef typename LOGGER_TRAITS::CHAR_TYPE char_type;
+    constexpr static bool reorder = QUEUE_TRAITS::REORDER_WINDOW_SIZE > 0;
+
+    constexpr static unsigned int SLOTS_PER_WORKER = 2;
+    /** Room for a whole batch of formatted records */
+    constexpr static std::size_t SLOT_SIZE = QUEUE_TRAITS::CONSUMER_BATCH_SIZE * formatter_type::buffer_size;
+
+protected:
+    struct Worker
+    {
+        std::thread thread;
+        CBackoff backoff;
+        formatter_type formatter;
+        std::unique_ptr<record_type[]> batch;
+
+        explicit Worker(const CBackoff& b) : backoff(b), batch(new record_type[QUEUE_TRAITS::CONSUMER_BATCH_SIZE]) {}
+    };
+
+    /** A formatted line in a slot, with the time stamp of its record */
+    struct FormattedLine
+    {
+        const char_type* data;
+        std::size_t size;
+        int64_t time;
+        bool timed;
+
+        friend bool record_time(const FormattedLine& line, int64_t& ns) noexcept { ns = line.time; return line.timed; }
+    };
+
+    /** Copy of a line held by the reorder window */
+    struct HeldLine
+    {
+        std::size_t size = {};
+        int64_t time = {};
+        bool timed = {};
+        char_type data[formatter_type::buffer_size];
+
+        HeldLine& operator=(const FormattedLine& line)
+        {
+            size = line.size;
+            time = line.time;
+            timed = line.timed;
+            std::memcpy(data, line.data, size * sizeof(char_type));
+            return *this;
+        }
+        friend bool record_time(const HeldLine& line, int64_t& ns) noexcept { ns = line.time; return line.timed; }
+    };
+
+    /** Formatted batch */
+    struct Slot
+    {
+        std::unique_ptr<char_type[]> data;
+        std::size_t size = {};
+        /** The lines in data, with the reorder window only */
+        std::unique_ptr<FormattedLine[]> lines;
+        std::size_t count = {};
+        /** Ticket + 1 once formatted */
+        std::atomic<uint64_t> ready = {};
+    };
+
+    std::vector<std::unique_ptr<Worker>> m_Workers;
+    std::unique_ptr<Slot[]> m_Slots;
+    std::size_t m_SlotCount;
+
+    /** Serializes dequeue and ticket assignment */
+    std::mutex m_DequeueMutex;
+    std::atomic<uint64_t> m_Tickets;
+    /** Slots written to the sink, i.e. the next ticket to be written */
+    std::atomic<uint64_t> m_Written;
+    /** Held by the worker writing to the sink */
+    std::atomic<bool> m_Writing;
+    /** Time stamp ordering across batches, with QUEUE_TRAITS::REORDER_WINDOW_SIZE; used by the sequencer only */
+    CReorderWindowT<HeldLine> m_Reorder;
+
+    const ThreadOptions m_ThreadOptions;
+    std::atomic<int> m_ThreadError;
+
+    std::string m_FileName;
+    SINK m_Sink;
+
+public:
+    /** workers formatting threads, each waiting according to backoff when the queue is empty;
+     *  sink_args follow the file name in the SINK constructor
+     */
+    template<typename... SinkArgs>
+    CLogConsumerPoolT(
+        const std::string& filename, queue_type& queue, unsigned int workers, const CBackoff& backoff,
+        SinkArgs&&... sink_args
+    ) :
+        CLogConsumerPoolT(filename, queue, workers, ThreadOptions(), backoff, std::forward<SinkArgs>(sink_args)...)
+    {}
+    /** Workers with the given affinity and scheduling, named after thread_options.name and their index */
+    template<typename... SinkArgs>
+    CLogConsumerPoolT(
+        const std::string& filename, queue_type& queue, unsigned int workers,
+        const ThreadOptions& thread_options, const CBackoff& backoff,
+        SinkArgs&&... sink_args
+    ) :
+        base_type(queue),
+        m_SlotCount(SLOTS_PER_WORKER * (workers ? workers : 1)),
+        m_Tickets(0), m_Written(0), m_Writing(false),
+        m_Reorder(QUEUE_TRAITS::REORDER_WINDOW_SIZE, std::chrono::microseconds(QUEUE_TRAITS::REORDER_WINDOW_US)),
+        m_ThreadOptions(thread_options), m_ThreadError(0),
+        m_FileName(filename),
+        m_Sink(filename, std::forward<SinkArgs>(sink_args)...)
+    {
+#if defined(USE_TSC_CLOCK)
+        // Initial calibration, out of the consumer loop
+        CTscCalibration::get();
+#endif
+        m_Slots.reset(new Slot[m_SlotCount]);
+        for (std::size_t i = {}; i < m_SlotCount; i++) {
+            m_Slots[i].data.reset(new char_type[SLOT_SIZE]);
+            if constexpr (reorder)
+                m_Slots[i].lines.reset(new FormattedLine[QUEUE_TRAITS::CONSUMER_BATCH_SIZE]);
+        }
+        for (unsigned int i = {}; i < (workers ? workers : 1); i++)
+            m_Workers.emplace_back(new Worker(backoff));
+        for (unsigned int i = {}; i < m_Workers.size(); i++)
+            m_Workers[i]->thread = std::thread(&CLogConsumerPoolT::_work, this, i);
+    }
+
+    virtual ~CLogConsumerPoolT() { stop(); }
+
+    /** Consumption runs in the worker threads */
+    virtual void consume() {}
+
+    /** Time spent idle so far by all the workers, by backoff phase */
+    BackoffStats getBackoffStats() const
+    {
+        BackoffStats stats;
+        for (const auto& w : m_Workers)
+            stats += w->backoff.getStats();
+        return stats;
+    }
+    /** Bytes written and system calls made so far by the sink */
+    SinkStats getSinkStats() const { return m_Sink.getStats(); }
+    /** The sink, for sink specific statistics and controls */
+    SINK& getSink() { return m_Sink; }
+    std::size_t workers() const { return m_Workers.size(); }
+    /** Records written out of time stamp order despite the reorder window */
+    uint64_t getLateRecords() const { return m_Reorder.late(); }
+    /** Error number of the first thread option a worker could not apply, 0 if none or not applied yet */
+    int getThreadError() const { return m_ThreadError.load(); }
+
+    void stop()
+    {
+        if (m_Workers.empty() || !m_Workers[0]->thread.joinable())
+            return;
+        this->m_Stop.store(true);
+        this->m_Queue.notifier().wake();
+        for (auto& w : m_Workers)
+            w->thread.join();
+        // Every ticket has been formatted
+        _drain(m_Workers[0]->formatter);
+        if constexpr (reorder)
+            m_Reorder.drain(_writer());
+        m_Sink.flush();
+        m_Sink.close();
+    }
+
+protected:
+    inline Slot& _slot(uint64_t ticket) { return m_Slots[ticket % m_SlotCount]; }
+
+    void _work(unsigned int index)
+    {
+        Worker& worker(*m_Workers[index]);
+        ThreadOptions options(m_ThreadOptions);
+        if (!options.name.empty())
+            options.name = options.name.substr(0, 12) + "/" + std::to_string(index);
+        const int error(apply_thread_options(options));
+        int expected(0);
+        if (error)
+            m_ThreadError.compare_exchange_strong(expected, error);
+
+        if constexpr (base_type::use_consumer_token) {
+            moodycamel::ConsumerToken token(this->m_Queue);
+            _consume(
+                index, worker,
+                [this, &token, &worker] ()
+                { return this->m_Queue.try_dequeue_bulk(token, worker.batch.get(), QUEUE_TRAITS::CONSUMER_BATCH_SIZE); }
+            );
+        }
+        else {
+            _consume(
+                index, worker,
+                [this, &worker] ()
+                { return this->m_Queue.try_dequeue_bulk(worker.batch.get(), QUEUE_TRAITS::CONSUMER_BATCH_SIZE); }
+            );
+        }
+    }
+
+    /** Worker loop, DEQUEUE fills worker.batch and returns the number of records */
+    template<typename DEQUEUE>
+    void _consume(unsigned int index, Worker& worker, DEQUEUE&& dequeue)
+    {
+#if defined(USE_TSC_CLOCK)
+        const std::chrono::milliseconds calibration_interval(LOGGER_TRAITS::TSC_CALIBRATION_INTERVAL_MS);
+        auto last_calibration(std::chrono::steady_clock::now());
+#else
+        (void)index;
+#endif
+        while (!this->m_Stop.load(std::memory_order_acquire)) {
+#if defined(USE_TSC_CLOCK)
+            // A single worker recalibrates
+            const auto now(std::chrono::steady_clock::now());
+            if (index == 0 && now - last_calibration >= calibration_interval) {
+                CTscCalibration::get().calibrate();
+                last_calibration = now;
+            }
+#endif
+            bool work(false);
+            bool drained(false);
+            for (std::size_t batches = {}; batches < QUEUE_TRAITS::CONSUMER_MAX_BATCHES; batches++) {
+                std::size_t count;
+                uint64_t ticket;
+                {
+                    std::lock_guard<std::mutex> lock(m_DequeueMutex);
+                    if ((count = dequeue()) == 0) {
+                        drained = true;
+                        break;
+                    }
+                    ticket = m_Tickets.load(std::memory_order_relaxed);
+                    m_Tickets.store(ticket + 1, std::memory_order_relaxed);
+                }
+                if constexpr (QUEUE_TRAITS::NOTIFY_CONSUMER) {
+                    // More to come, get a sleeping sibling going
+                    if (count == QUEUE_TRAITS::CONSUMER_BATCH_SIZE)
+                        this->m_Queue.notifier().notify();
+                }
+                // The slot is free once the ticket SLOTS_PER_WORKER * workers before has been written
+                while (m_Written.load(std::memory_order_acquire) + m_SlotCount <= ticket) {
+                    _drain(worker.formatter);
+                    std::this_thread::yield();
+                }
+                Slot& slot(_slot(ticket));
+                _format(worker, count, slot);
+                slot.ready.store(ticket + 1, std::memory_order_seq_cst);
+                _drain(worker.formatter);
+                work = true;
+            }
+            // Covers drops reported and lines held while no batch is flowing
+            _drain(worker.formatter, drained);
+            if (work)
+                worker.backoff.reset();
+            else if constexpr (QUEUE_TRAITS::NOTIFY_CONSUMER) {
+                // Sleep until a producer enqueues
+                worker.backoff.idle(
+                    [this] (std::chrono::microseconds timeout)
+                    {
+                        this->m_Queue.notifier().wait(
+                            timeout, [this] () { return this->m_Queue.size_approx() == 0 && !this->m_Stop.load(); }
+                        );
+                    }
+                );
+            }
+            else
+                worker.backoff.idle();
+        }
+    }
+
+    /** Format count records of the worker batch into slot */
+    void _format(Worker& worker, std::size_t count, Slot& slot)
+    {
+        uint8_t order[QUEUE_TRAITS::CONSUMER_BATCH_SIZE];
+        static_assert(QUEUE_TRAITS::CONSUMER_BATCH_SIZE <= 256, "CONSUMER_BATCH_SIZE too large");
+        for (std::size_t i = {}; i < count; i++)
+            order[i] = static_cast<uint8_t>(i);
+        int64_t times[QUEUE_TRAITS::CONSUMER_BATCH_SIZE] = {};
+        bool timed[QUEUE_TRAITS::CONSUMER_BATCH_SIZE] = {};
+#if defined(USE_TIMEPOINT)
+        for (std::size_t i = {}; i < count; i++) {
+            if (!(timed[i] = record_time(worker.batch[i], times[i])))
+                times[i] = 0;
+        }
+        // Insertion sort, batches from a single producer are already in order; the reorder window sorts across batches
+        for (std::size_t i = 1; i < count; i++) {
+            const uint8_t current(order[i]);
+            std::size_t j(i);
+            for (; j > 0 && times[order[j - 1]] > times[current]; j--)
+                order[j] = order[j - 1];
+            order[j] = current;
+        }
+#endif
+        char_type* buffer(slot.data.get());
+        std::size_t size = {};
+        for (std::size_t i = {}; i < count; i++) {
+            const std::size_t length(worker.formatter.format_to(worker.batch[order[i]], buffer + size));
+            if constexpr (reorder)
+                slot.lines[i] = FormattedLine{buffer + size, length, times[order[i]], timed[order[i]]};
+            size += length;
+        }
+        slot.size = size;
+        slot.count = count;
+    }
+
+    /** Sink for the lines leaving the reorder window */
+    inline auto _writer()
+    {
+        return [this] (HeldLine& line) { m_Sink.write(line.data, line.size); };
+    }
+
+    /** Sequencer, write the formatted slots in ticket order if no other worker is doing it.
+     *  drained: the caller found the queue empty, lines held long enough by the reorder window are released
+     */
+    void _drain(formatter_type& formatter, bool drained = false)
+    {
+        while (!m_Writing.exchange(true, std::memory_order_seq_cst)) {
+            uint64_t written(m_Written.load(std::memory_order_relaxed));
+            bool wrote(false);
+            while (_slot(written).ready.load(std::memory_order_seq_cst) == written + 1) {
+                Slot& slot(_slot(written));
+                if constexpr (reorder) {
+                    for (std::size_t i = {}; i < slot.count; i++)
+                        m_Reorder.push(slot.lines[i], _writer());
+                    m_Reorder.pop(_writer());
+                }
+                else
+                    m_Sink.write(slot.data.get(), slot.size);
+                written++;
+                m_Written.store(written, std::memory_order_release);
+                wrote = true;
+            }
+            if constexpr (reorder) {
+                // Only once nothing is being formatted either, a batch in flight may hold older lines
+                if (drained && written == m_Tickets.load(std::memory_order_relaxed) &&
+                    !m_Reorder.empty() && m_Reorder.expire(record_clock_ns(), _writer()))
+                    wrote = true;
+            }
+            DropCount delta;
+            if (this->newDrops(delta)) {
+                const char_type* p(formatter.format_dropped(delta));
+                m_Sink.write(p, formatter.size());
+                wrote = true;
+            }
+            // End of a batch for the sink once nothing is being formatted
+            if (wrote && written == m_Tickets.load(std::memory_order_relaxed))
+                m_Sink.flush();
+            m_Writing.store(false, std::memory_order_seq_cst);
+            // A slot made ready while the flag was held would be left behind otherwise
+            if (_slot(written).ready.load(std::memory_order_seq_cst) != written + 1)
+                break;
+        }
+    }
+};
+using CLogConsumerPool = CLogConsumerPoolT<rtlog::LoggerTraits, rtlog::ConcurrentQueueTraits>;
+
+}  // namespace rtlog
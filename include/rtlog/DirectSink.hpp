@@ -0,0 +1,187 @@
+/** \file
+ *  O_DIRECT output sink, bypassing the page cache
+ */
+
+#pragma once
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <atomic>
+#include <string>
+
+#include "Sink.hpp"
+
+namespace rtlog {
+
+/** Sink writing through O_DIRECT so the log does not evict application data from the page cache.
+ *  Lines are staged in a BLOCK_SIZE aligned buffer and written at block aligned offsets with pwrite.
+ *  At the end of a batch the final partial block is padded with zeros, written, and the file
+ *  truncated back to the real size; the block stays in the buffer and is rewritten in place by the
+ *  next write, so readers never see the padding.
+ *  Falls back to buffered I/O if the filesystem does not support O_DIRECT, see is_direct().
+ */
+class CDirectSink
+{
+public:
+    constexpr static bool DIRECT = true;
+    constexpr static std::size_t BLOCK_SIZE = 4096;
+    constexpr static std::size_t DEFAULT_BUFFER_SIZE = 1 << 20;
+
+protected:
+    int m_Fd;
+    bool m_Direct;
+    char* m_Buffer;
+    std::size_t m_Capacity;
+    std::size_t m_Used;
+    /** File offset of the buffer start, always block aligned */
+    uint64_t m_Offset;
+    /** Buffered bytes already on disk, in the padded tail block */
+    std::size_t m_Written;
+    std::atomic<uint64_t> m_Bytes;
+    std::atomic<uint64_t> m_Syscalls;
+
+    inline static void _add(std::atomic<uint64_t>& counter, uint64_t value)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    inline static std::size_t _round_down(std::size_t size) { return size & ~(BLOCK_SIZE - 1); }
+    inline static std::size_t _round_up(std::size_t size) { return _round_down(size + BLOCK_SIZE - 1); }
+
+    static int _open(const std::string& filename, bool& direct)
+    {
+        const int flags(O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC);
+        int fd(::open(filename.c_str(), flags|O_DIRECT, 0644));
+        direct = fd >= 0;
+        if (fd < 0 && errno == EINVAL)
+            fd = ::open(filename.c_str(), flags, 0644);
+        return fd;
+    }
+
+    /** pwrite all of the buffer at offset, retrying on partial writes and EINTR; errors drop the data */
+    void _write_all(const char* data, std::size_t size, uint64_t offset)
+    {
+        while (size > 0) {
+            const ssize_t written(::pwrite(m_Fd, data, size, static_cast<off_t>(offset)));
+            _add(m_Syscalls, 1);
+            if (written < 0) {
+                if (errno == EINTR)
+                    continue;
+                return;
+            }
+            data += written;
+            size -= written;
+            offset += written;
+        }
+    }
+
+    /** Write the buffered blocks, the partial tail one too when pad is set, and keep the tail in the buffer */
+    void _write_blocks(bool pad)
+    {
+        if (m_Fd < 0 || m_Used == m_Written)
+            return;
+        const std::size_t full(_round_down(m_Used));
+        const std::size_t size(pad ? _round_up(m_Used) : full);
+        if (size == 0)
+            return;
+        if (size > m_Used)
+            std::memset(m_Buffer + m_Used, 0, size - m_Used);
+        _write_all(m_Buffer, size, m_Offset);
+        _add(m_Bytes, (pad ? m_Used : full) - m_Written);
+
+        const std::size_t tail(m_Used - full);
+        if (size > m_Used) {
+            // Trim the padding
+            ::ftruncate(m_Fd, static_cast<off_t>(m_Offset + m_Used));
+            _add(m_Syscalls, 1);
+        }
+        if (tail)
+            std::memmove(m_Buffer, m_Buffer + full, tail);
+        m_Offset += full;
+        m_Used = tail;
+        m_Written = size > full ? tail : 0;
+    }
+
+public:
+    explicit CDirectSink(const std::string& filename, std::size_t buffer_size = DEFAULT_BUFFER_SIZE) :
+        m_Fd(_open(filename, m_Direct)),
+        m_Buffer(nullptr),
+        // At least one block besides the tail
+        m_Capacity(_round_up(buffer_size > 2 * BLOCK_SIZE ? buffer_size : 2 * BLOCK_SIZE)),
+        m_Used(0), m_Offset(0), m_Written(0),
+        m_Bytes(0), m_Syscalls(0)
+    {
+        void* buffer;
+        if (posix_memalign(&buffer, BLOCK_SIZE, m_Capacity) == 0)
+            m_Buffer = static_cast<char*>(buffer);
+        else if (m_Fd >= 0) {
+            // Like std::ofstream, a sink that failed to set up silently discards the output
+            ::close(m_Fd);
+            m_Fd = -1;
+        }
+    }
+    CDirectSink(const CDirectSink&) = delete;
+    CDirectSink& operator=(const CDirectSink&) = delete;
+    ~CDirectSink()
+    {
+        close();
+        std::free(m_Buffer);
+    }
+
+    inline void write(const char* data, std::size_t size)
+    {
+        while (size > 0 && m_Fd >= 0) {
+            if (m_Used == m_Capacity)
+                _write_blocks(false);
+            const std::size_t room(m_Capacity - m_Used);
+            const std::size_t chunk(size < room ? size : room);
+            std::memcpy(m_Buffer + m_Used, data, chunk);
+            m_Used += chunk;
+            data += chunk;
+            size -= chunk;
+        }
+    }
+
+    /** Writes the full blocks out when the room left is less than size */
+    inline char* reserve(std::size_t size)
+    {
+        if (size > m_Capacity - m_Used) {
+            _write_blocks(false);
+            if (m_Fd < 0 || size > m_Capacity - m_Used)
+                return nullptr;
+        }
+        return m_Buffer + m_Used;
+    }
+    inline void commit(std::size_t size) { m_Used += size; }
+
+    /** End of a batch, the partial block is written padded */
+    void flush() { _write_blocks(true); }
+
+    void close()
+    {
+        if (m_Fd < 0)
+            return;
+        _write_blocks(true);
+        ::close(m_Fd);
+        m_Fd = -1;
+    }
+
+    bool is_open() const { return m_Fd >= 0; }
+    /** false if the filesystem did not accept O_DIRECT */
+    bool is_direct() const { return m_Direct; }
+
+    SinkStats getStats() const
+    {
+        SinkStats stats;
+        stats.bytes = m_Bytes.load(std::memory_order_relaxed);
+        stats.syscalls = m_Syscalls.load(std::memory_order_relaxed);
+        return stats;
+    }
+};
+
+}  // namespace rtlog
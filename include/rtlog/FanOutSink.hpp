@@ -0,0 +1,114 @@
+/** \file
+ *  Output sink feeding several sinks, each with its own minimum level
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Levels.hpp"
+#include "Sink.hpp"
+
+namespace rtlog {
+
+/** Secondary sink of a CFanOutSinkT and the lowest level it receives */
+struct SinkRoute
+{
+    std::unique_ptr<CSinkBase> sink;
+    LogLevel level;
+
+    SinkRoute(std::unique_ptr<CSinkBase>&& s, LogLevel l) : sink(std::move(s)), level(l) {}
+};
+
+/** Sends each formatted line to a PRIMARY sink opened on the consumer file name and to any number
+ *  of secondary sinks of any type, e.g. CRIT records to a small low latency file and a stdout mirror.
+ *  Each sink only gets the records at or above its level, records nobody accepts are not formatted.
+ *  A record is formatted once and the same line shared by all the sinks, as they all use the
+ *  consumer formatter layout. Drop reports go to every sink.
+ *  Usage: CLogConsumerSingleFileT<..., CFanOutSink> consumer(filename, queue, backoff, level, std::move(routes))
+ */
+template<typename PRIMARY = CFdSink>
+class CFanOutSinkT
+{
+public:
+    constexpr static bool DIRECT = false;
+    constexpr static bool LEVELS = true;
+
+protected:
+    PRIMARY m_Primary;
+    const LogLevel m_Level;
+    std::vector<SinkRoute> m_Routes;
+    /** Lowest level accepted by any sink */
+    LogLevel m_MinLevel;
+
+public:
+    CFanOutSinkT(const std::string& filename, LogLevel level, std::vector<SinkRoute>&& routes = std::vector<SinkRoute>()) :
+        m_Primary(filename),
+        m_Level(level),
+        m_Routes(std::move(routes)),
+        m_MinLevel(level)
+    {
+        for (const auto& route : m_Routes) {
+            if (route.level < m_MinLevel)
+                m_MinLevel = route.level;
+        }
+    }
+
+    inline bool accepts(LogLevel level) const { return level >= m_MinLevel; }
+
+    inline void write(const char* data, std::size_t size, LogLevel level)
+    {
+        if (level >= m_Level)
+            m_Primary.write(data, size);
+        for (auto& route : m_Routes) {
+            if (level >= route.level)
+                route.sink->write(data, size);
+        }
+    }
+
+    /** Lines without a level, i.e. drop reports, go everywhere */
+    inline void write(const char* data, std::size_t size)
+    {
+        m_Primary.write(data, size);
+        for (auto& route : m_Routes)
+            route.sink->write(data, size);
+    }
+
+    void flush()
+    {
+        m_Primary.flush();
+        for (auto& route : m_Routes)
+            route.sink->flush();
+    }
+
+    void close()
+    {
+        m_Primary.close();
+        for (auto& route : m_Routes)
+            route.sink->close();
+    }
+
+    /** Totals over all the sinks */
+    SinkStats getStats() const
+    {
+        SinkStats stats(m_Primary.getStats());
+        for (const auto& route : m_Routes) {
+            const SinkStats s(route.sink->getStats());
+            stats.bytes += s.bytes;
+            stats.syscalls += s.syscalls;
+        }
+        return stats;
+    }
+
+    PRIMARY& primary() { return m_Primary; }
+    std::size_t routes() const { return m_Routes.size(); }
+    /** Secondary sink i, in construction order */
+    CSinkBase& route(std::size_t i) { return *m_Routes[i].sink; }
+};
+
+using CFanOutSink = CFanOutSinkT<>;
+
+}  // namespace rtlog
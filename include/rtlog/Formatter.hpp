@@ -5,6 +5,9 @@
 #pragma once
 
 #include "Argument.hpp"
+#include "Overflow.hpp"
+#include "Record.hpp"
+#include "Site.hpp"
 #include "../concurrentqueue.h"
 #include "../Traits.hpp"
 
@@ -32,21 +35,105 @@ public:
 
     const char_type* get() const noexcept
     { return m_Writer.c_str(); }
+    /** Length of the last formatted message */
+    std::size_t size() const noexcept
+    { return m_Writer.size(); }
 
     /** Performs a single message formatting and return internal pointer */
     const char_type* format(rtlog::ArgumentArrayT<LOGGER_TRAITS>& argument_array)
     {
         m_Writer.clear();
+        return _format(m_Writer, argument_array) ? m_Writer.c_str() : NULL;
+    }
+
+    /** Performs a single packed message formatting and return internal pointer */
+    const char_type* format(const rtlog::PackedRecordT<LOGGER_TRAITS>& record)
+    {
+        m_Writer.clear();
+        return _format(m_Writer, record) ? m_Writer.c_str() : NULL;
+    }
+
+    /** Format a message straight into buffer, which must have room for buffer_size chars.
+     *  \return the message length, not null terminated, or 0 if the message is incomplete
+     */
+    template<typename RECORD>
+    std::size_t format_to(RECORD& record, char_type* buffer)
+    {
+        fmt::BasicArrayWriter<char_type> writer(buffer, buffer_size);
+        return _format(writer, record) ? writer.size() : 0;
+    }
+
+    /** Format the synthetic record reporting lost messages */
+    const char_type* format_dropped(const DropCount& drops)
+    {
+        m_Writer.clear();
+        m_Writer << drops.total() << " messages dropped:";
+        m_Writer << " " << LogLevelSignature<LogLevel::INFO>::signature << " " << drops.levels[LogLevel::INFO];
+        m_Writer << " " << LogLevelSignature<LogLevel::WARN>::signature << " " << drops.levels[LogLevel::WARN];
+        m_Writer << " " << LogLevelSignature<LogLevel::CRIT>::signature << " " << drops.levels[LogLevel::CRIT];
+        m_Writer << " overwritten " << drops.overwritten;
+        // Breakdown of the dropped ones by thread ID, as long as the buffer allows
+        constexpr std::size_t ENTRY_SIZE = 64;
+        bool first(true);
+        for (const auto& thread : drops.threads) {
+            if (thread.dropped == 0)
+                continue;
+            if (m_Writer.size() + ENTRY_SIZE > buffer_size) {
+                m_Writer << " ...";
+                break;
+            }
+            m_Writer << (first ? " threads " : " ") << thread.thread << ":" << thread.dropped;
+            first = false;
+        }
+        m_Writer << '\n';
+        return m_Writer.c_str();
+    }
+
+protected:
+    template<typename WRITER>
+    bool _format(WRITER& writer, rtlog::ArgumentArrayT<LOGGER_TRAITS>& argument_array)
+    {
         for (auto& elem : argument_array) {
             if (elem.empty())
                 break;  // Encountered an empty element before end marker, message incomplete
 
-            m_Writer << elem;
+            writer << elem;
 
             if (Argument::is_type<rtlog::_ArrayEndMarker>(elem))
-                return m_Writer.c_str();  // End of message found
+                return true;  // End of message found
+        }
+        return false;  // No message enqueued
+    }
+
+    template<typename WRITER>
+    bool _format(WRITER& writer, const rtlog::PackedRecordT<LOGGER_TRAITS>& record)
+    {
+        std::size_t pos = {};
+        uint32_t site_id;
+        if (record.pop_site(pos, site_id))
+            return _format_site(writer, record, pos, CSiteRegistryT<LOGGER_TRAITS>::get(site_id));
+
+        while (record.pop(pos, m_Argument)) {
+            writer << m_Argument;
+
+            if (Argument::is_type<rtlog::_ArrayEndMarker>(m_Argument))
+                return true;  // End of message found
+        }
+        return false;  // Message incomplete
+    }
+
+    /** Format the untagged payloads of a site record, level and position come from the registry */
+    template<typename WRITER>
+    bool _format_site(WRITER& writer, const rtlog::PackedRecordT<LOGGER_TRAITS>& record, std::size_t pos, const LogSite& site)
+    {
+        for (std::size_t i = {}; i < site.count; i++) {
+            if (i == site.prefix)
+                writer << Argument(site.level) << Argument(site.position);
+            record.pop_raw(pos, site.types[i], m_Argument);
+            writer << m_Argument;
         }
-        return NULL;  // No message enqueued
+        writer << Argument(_ArrayEndMarker());
+        return true;
     }
 };
 
@@ -4,13 +4,23 @@
 
 #pragma once
 
+/** Log level values usable by the preprocessor */
+#define RTLOG_LEVEL_INFO 0
+#define RTLOG_LEVEL_WARN 1
+#define RTLOG_LEVEL_CRIT 2
+
+/** Compile time minimum level: LOG_ macros below it expand to nothing, arguments are not evaluated */
+#if !defined(RTLOG_MIN_LEVEL)
+#   define RTLOG_MIN_LEVEL RTLOG_LEVEL_INFO
+#endif
+
 namespace rtlog {
 
 enum LogLevel : unsigned int
 {
-    INFO = 0,
-    WARN = 1,
-    CRIT = 2
+    INFO = RTLOG_LEVEL_INFO,
+    WARN = RTLOG_LEVEL_WARN,
+    CRIT = RTLOG_LEVEL_CRIT
 };
 
 // Specific types for each log level
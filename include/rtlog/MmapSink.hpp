@@ -0,0 +1,162 @@
+/** \file
+ *  Memory mapped file output sink
+ */
+
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include <atomic>
+#include <string>
+
+#include "Sink.hpp"
+
+namespace rtlog {
+
+/** Writes lines with memcpy into a window of the file mapped in memory, no system calls in the steady state.
+ *  When the room left in the window is less than a line the file is extended by window_size
+ *  (fallocate, ftruncate if not supported) and a new window is mapped starting at the page holding
+ *  the current position, so lines never straddle two windows. The completed window is scheduled
+ *  for writeback with msync(MS_ASYNC) and dropped with madvise(MADV_DONTNEED) before being unmapped.
+ *  close() truncates the file to the bytes actually written.
+ */
+class CMmapSink
+{
+public:
+    constexpr static bool DIRECT = true;
+    constexpr static std::size_t PAGE_SIZE = 4096;
+    constexpr static std::size_t DEFAULT_WINDOW_SIZE = 64 * 1024 * 1024;
+
+protected:
+    int m_Fd;
+    const std::size_t m_WindowSize;
+    /** Current window, mapped at file offset m_WindowOffset */
+    char* m_Window;
+    uint64_t m_WindowOffset;
+    /** Write position in the window, and file size reserved so far */
+    std::size_t m_Used;
+    uint64_t m_FileSize;
+    std::atomic<uint64_t> m_Bytes;
+    std::atomic<uint64_t> m_Syscalls;
+
+    inline static void _add(std::atomic<uint64_t>& counter, uint64_t value)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    void _unmap()
+    {
+        if (!m_Window)
+            return;
+        ::msync(m_Window, m_WindowSize, MS_ASYNC);
+        ::madvise(m_Window, m_WindowSize, MADV_DONTNEED);
+        ::munmap(m_Window, m_WindowSize);
+        _add(m_Syscalls, 3);
+        m_Window = nullptr;
+    }
+
+    /** Map a new window starting at the page holding the current position */
+    bool _advance()
+    {
+        const uint64_t position(m_WindowOffset + m_Used);
+        const uint64_t offset(position & ~static_cast<uint64_t>(PAGE_SIZE - 1));
+        _unmap();
+
+        if (offset + m_WindowSize > m_FileSize) {
+            const uint64_t size(offset + m_WindowSize);
+            bool extended(false);
+#if defined(__linux__)
+            extended = ::fallocate(m_Fd, 0, static_cast<off_t>(m_FileSize), static_cast<off_t>(size - m_FileSize)) == 0;
+#endif
+            if (!extended && ::ftruncate(m_Fd, static_cast<off_t>(size)) != 0)
+                return false;
+            _add(m_Syscalls, 1);
+            m_FileSize = size;
+        }
+        void* window(::mmap(nullptr, m_WindowSize, PROT_READ|PROT_WRITE, MAP_SHARED, m_Fd, static_cast<off_t>(offset)));
+        _add(m_Syscalls, 1);
+        if (window == MAP_FAILED)
+            return false;
+        m_Window = static_cast<char*>(window);
+        m_WindowOffset = offset;
+        m_Used = position - offset;
+        return true;
+    }
+
+public:
+    explicit CMmapSink(const std::string& filename, std::size_t window_size = DEFAULT_WINDOW_SIZE) :
+        m_Fd(::open(filename.c_str(), O_RDWR|O_CREAT|O_TRUNC|O_CLOEXEC, 0644)),
+        m_WindowSize((window_size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1)),
+        m_Window(nullptr), m_WindowOffset(0), m_Used(0), m_FileSize(0),
+        m_Bytes(0), m_Syscalls(0)
+    {
+        // Like std::ofstream, a sink that failed to open silently discards the output
+        if (m_Fd >= 0)
+            _advance();
+    }
+    CMmapSink(const CMmapSink&) = delete;
+    CMmapSink& operator=(const CMmapSink&) = delete;
+    ~CMmapSink() { close(); }
+
+    /** Advances the window when the room left is less than size */
+    inline char* reserve(std::size_t size)
+    {
+        if (size > m_WindowSize - PAGE_SIZE)
+            return nullptr;
+        if (!m_Window || size > m_WindowSize - m_Used) {
+            if (m_Fd < 0 || !_advance())
+                return nullptr;
+        }
+        return m_Window + m_Used;
+    }
+    inline void commit(std::size_t size)
+    {
+        m_Used += size;
+        _add(m_Bytes, size);
+    }
+
+    inline void write(const char* data, std::size_t size)
+    {
+        // Split lines larger than a window
+        while (size > 0) {
+            const std::size_t chunk(size < m_WindowSize - PAGE_SIZE ? size : m_WindowSize - PAGE_SIZE);
+            char* buffer(reserve(chunk));
+            if (!buffer)
+                return;  // Errors drop the data
+            std::memcpy(buffer, data, chunk);
+            commit(chunk);
+            data += chunk;
+            size -= chunk;
+        }
+    }
+
+    /** The mapping is shared with the page cache, nothing to do */
+    void flush() {}
+
+    void close()
+    {
+        if (m_Fd < 0)
+            return;
+        const uint64_t size(m_WindowOffset + m_Used);
+        _unmap();
+        ::ftruncate(m_Fd, static_cast<off_t>(size));
+        ::close(m_Fd);
+        m_Fd = -1;
+    }
+
+    bool is_open() const { return m_Fd >= 0; }
+
+    SinkStats getStats() const
+    {
+        SinkStats stats;
+        stats.bytes = m_Bytes.load(std::memory_order_relaxed);
+        stats.syscalls = m_Syscalls.load(std::memory_order_relaxed);
+        return stats;
+    }
+};
+
+}  // namespace rtlog
@@ -0,0 +1,93 @@
+/** \file
+ *  Producer to consumer wakeup, lets an idle consumer block instead of polling
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <thread>
+
+#if defined(__linux__)
+#   include <linux/futex.h>
+#   include <sys/syscall.h>
+#   include <time.h>
+#   include <unistd.h>
+#endif
+
+namespace rtlog {
+
+/** Wakes up a consumer sleeping on an empty queue.
+ *  The consumer announces it's going to sleep by setting the futex word, producers clear it after
+ *  an enqueue and only the one that actually clears it makes the wake syscall: a burst of messages
+ *  costs at most one syscall for each time the consumer went idle.
+ *  Without a waiting consumer notify() is a fence and a load of a shared cache line.
+ */
+class CConsumerNotifier
+{
+protected:
+    /** 1 while the consumer is, or is about to be, sleeping */
+    alignas(64) std::atomic<uint32_t> m_Waiting;
+    std::atomic<uint64_t> m_Wakeups;
+
+    void _wake()
+    {
+        m_Wakeups.fetch_add(1, std::memory_order_relaxed);
+#if defined(__linux__)
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&m_Waiting), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#endif
+    }
+
+public:
+    CConsumerNotifier() : m_Waiting(0), m_Wakeups(0) {}
+
+    /** Producer side, call after each successful enqueue */
+    inline void notify()
+    {
+        // Order the enqueue before the check, pairs with the fence in wait()
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_Waiting.load(std::memory_order_relaxed) && m_Waiting.exchange(0, std::memory_order_relaxed))
+            _wake();
+    }
+
+    /** Wake all the sleeping consumers unconditionally, e.g. to stop them */
+    void wake()
+    {
+        m_Waiting.store(0, std::memory_order_relaxed);
+#if defined(__linux__)
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&m_Waiting), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#endif
+    }
+
+    /** Consumer side, sleep until notified or timeout.
+     *  empty() must check the queue again after the consumer has announced itself, to close the
+     *  window where a producer enqueued after the last drain but before m_Waiting was set.
+     */
+    template<typename EMPTY>
+    void wait(std::chrono::microseconds timeout, EMPTY&& empty)
+    {
+        m_Waiting.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!empty()) {
+            m_Waiting.store(0, std::memory_order_relaxed);
+            return;
+        }
+#if defined(__linux__)
+        struct timespec ts;
+        ts.tv_sec = static_cast<time_t>(timeout.count() / 1000000);
+        ts.tv_nsec = static_cast<long>(timeout.count() % 1000000) * 1000;
+        // Returns immediately if a producer already cleared the word
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&m_Waiting), FUTEX_WAIT_PRIVATE, 1, &ts, nullptr, 0);
+#else
+        std::this_thread::sleep_for(timeout);
+#endif
+        m_Waiting.store(0, std::memory_order_relaxed);
+    }
+
+    /** Number of wake syscalls made by producers so far */
+    uint64_t wakeups() const { return m_Wakeups.load(std::memory_order_relaxed); }
+};
+
+}  // namespace rtlog
@@ -0,0 +1,223 @@
+/** \file
+ *  What to do when the queue is full, and how many messages were lost
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#   include <immintrin.h>
+#endif
+
+#include "Levels.hpp"
+
+namespace rtlog {
+
+/** Copy of the drop counters at some point in time */
+struct DropCount
+{
+    /** Threads with a drop count of their own, drops of further threads only count in levels */
+    constexpr static std::size_t MAX_THREADS = 64;
+
+    /** Messages of a thread dropped because they did not fit, thread 0 for an unused slot */
+    struct Thread
+    {
+        int64_t thread = {};
+        uint64_t dropped = {};
+    };
+
+    uint64_t levels[LogLevel::CRIT + 1] = {};
+    /** Older messages evicted by COverflowOverwriteOldestT, level and thread unknown */
+    uint64_t overwritten = {};
+    Thread threads[MAX_THREADS];
+
+    uint64_t total() const
+    {
+        uint64_t count(overwritten);
+        for (uint64_t l : levels)
+            count += l;
+        return count;
+    }
+
+    DropCount operator-(const DropCount& other) const
+    {
+        DropCount delta;
+        for (std::size_t i = {}; i <= LogLevel::CRIT; i++)
+            delta.levels[i] = levels[i] - other.levels[i];
+        delta.overwritten = overwritten - other.overwritten;
+        // Slots are never released, the same slot is the same thread in both
+        for (std::size_t i = {}; i < MAX_THREADS; i++) {
+            delta.threads[i].thread = threads[i].thread;
+            delta.threads[i].dropped = threads[i].dropped - other.threads[i].dropped;
+        }
+        return delta;
+    }
+};
+
+/** Per level and per thread count of messages lost because the queue was full.
+ *  Written by producers only on overflow, read by the consumer.
+ */
+class CDropCounters
+{
+protected:
+    struct Thread
+    {
+        std::atomic<int64_t> thread;
+        std::atomic<uint64_t> dropped;
+    };
+
+    std::atomic<uint64_t> m_Levels[LogLevel::CRIT + 1];
+    std::atomic<uint64_t> m_Overwritten;
+    /** Open addressing on the thread ID, a slot is claimed on the first drop of a thread */
+    Thread m_Threads[DropCount::MAX_THREADS];
+
+    Thread* _thread(int64_t thread)
+    {
+        const std::size_t start(static_cast<uint64_t>(thread) % DropCount::MAX_THREADS);
+        for (std::size_t i = {}; i < DropCount::MAX_THREADS; i++) {
+            Thread& slot(m_Threads[(start + i) % DropCount::MAX_THREADS]);
+            int64_t owner(slot.thread.load(std::memory_order_relaxed));
+            if (owner == 0 && slot.thread.compare_exchange_strong(owner, thread, std::memory_order_relaxed))
+                return &slot;
+            if (owner == thread)
+                return &slot;
+        }
+        return nullptr;
+    }
+
+public:
+    CDropCounters() : m_Overwritten(0)
+    {
+        for (auto& l : m_Levels)
+            l.store(0, std::memory_order_relaxed);
+        for (auto& t : m_Threads) {
+            t.thread.store(0, std::memory_order_relaxed);
+            t.dropped.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    /** A message of level could not be enqueued by thread, a non zero thread ID */
+    inline void dropped(LogLevel level, int64_t thread)
+    {
+        m_Levels[level].fetch_add(1, std::memory_order_relaxed);
+        if (Thread* slot = _thread(thread))
+            slot->dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+    inline void overwritten() { m_Overwritten.fetch_add(1, std::memory_order_relaxed); }
+
+    DropCount get() const
+    {
+        DropCount count;
+        for (std::size_t i = {}; i <= LogLevel::CRIT; i++)
+            count.levels[i] = m_Levels[i].load(std::memory_order_relaxed);
+        count.overwritten = m_Overwritten.load(std::memory_order_relaxed);
+        for (std::size_t i = {}; i < DropCount::MAX_THREADS; i++) {
+            count.threads[i].thread = m_Threads[i].thread.load(std::memory_order_relaxed);
+            count.threads[i].dropped = m_Threads[i].dropped.load(std::memory_order_relaxed);
+        }
+        return count;
+    }
+};
+
+/** CPU relax hint for spin loops */
+inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+/** Overflow policies, the OVERFLOW_POLICY template parameter of CLoggerT.
+ *  enqueue() is given a callable trying to enqueue the message once and a callable evicting
+ *  the oldest message in the queue; it returns false if the message has been dropped.
+ */
+
+/** Drop the message that does not fit, never wait: the default */
+struct COverflowDropNewest
+{
+    constexpr static bool EVICTS = false;
+
+    template<typename TRY_ENQUEUE, typename EVICT>
+    static inline bool enqueue(TRY_ENQUEUE&& try_enqueue, EVICT&&)
+    { return try_enqueue(); }
+};
+
+/** Make room dropping the oldest messages, one at a time until the new one fits or MAX_EVICTIONS
+ *  have gone. moodycamel::ConcurrentQueue only reuses a block once all of it has been dequeued,
+ *  so room for one message may cost up to BLOCK_SIZE evictions.
+ *  With producer tokens (ConcurrentQueueTraits::USE_PRODUCER_TOKEN) the evicted messages are the
+ *  calling thread's own. Without them they come from any producer and may not make room for the
+ *  calling one at all, e.g. when its own sub-queue is at MAX_SUBQUEUE_SIZE.
+ *  Every evicted message counts as overwritten, and the new one as dropped if it still does not fit.
+ *  Requires a transport where producers may dequeue (not CRingQueueT).
+ */
+template<unsigned int MAX_EVICTIONS>
+struct COverflowOverwriteOldestT
+{
+    constexpr static bool EVICTS = true;
+
+    template<typename TRY_ENQUEUE, typename EVICT>
+    static inline bool enqueue(TRY_ENQUEUE&& try_enqueue, EVICT&& evict)
+    {
+        if (try_enqueue())
+            return true;
+        for (unsigned int i = {}; i < MAX_EVICTIONS; i++) {
+            if (!evict())
+                return try_enqueue();
+            if (try_enqueue())
+                return true;
+        }
+        return false;
+    }
+};
+/** Up to a block of ConcurrentQueueTraits */
+using COverflowOverwriteOldest = COverflowOverwriteOldestT<32>;
+
+/** Retry up to SPINS times, pausing the CPU in between, then drop */
+template<unsigned int SPINS>
+struct COverflowSpinT
+{
+    constexpr static bool EVICTS = false;
+
+    template<typename TRY_ENQUEUE, typename EVICT>
+    static inline bool enqueue(TRY_ENQUEUE&& try_enqueue, EVICT&&)
+    {
+        for (unsigned int i = {}; i < SPINS; i++) {
+            if (try_enqueue())
+                return true;
+            cpu_relax();
+        }
+        return try_enqueue();
+    }
+};
+using COverflowSpin = COverflowSpinT<1000>;
+
+/** Wait for the consumer to make room, yielding the CPU, up to TIMEOUT_US microseconds then drop */
+template<unsigned int TIMEOUT_US>
+struct COverflowBlockT
+{
+    constexpr static bool EVICTS = false;
+
+    template<typename TRY_ENQUEUE, typename EVICT>
+    static inline bool enqueue(TRY_ENQUEUE&& try_enqueue, EVICT&&)
+    {
+        if (try_enqueue())
+            return true;
+        const auto deadline(std::chrono::steady_clock::now() + std::chrono::microseconds(TIMEOUT_US));
+        do {
+            std::this_thread::yield();
+            if (try_enqueue())
+                return true;
+        } while (std::chrono::steady_clock::now() < deadline);
+        return false;
+    }
+};
+using COverflowBlock = COverflowBlockT<1000>;
+
+}  // namespace rtlog
@@ -0,0 +1,243 @@
+/** \file
+ *  Pipelined output sink, a dedicated I/O thread writes while the consumer keeps formatting
+ */
+
+#pragma once
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Sink.hpp"
+
+namespace rtlog {
+
+/** Time spent by each pipeline stage, see CPipelineSink */
+struct PipelineStats
+{
+    uint64_t elapsed_ns = {};
+    /** I/O thread inside write() */
+    uint64_t io_busy_ns = {};
+    /** Formatting (consumer) thread waiting for a free buffer */
+    uint64_t format_stall_ns = {};
+
+    double io_utilization() const { return elapsed_ns ? static_cast<double>(io_busy_ns) / elapsed_ns : 0.0; }
+    /** Formatting stage utilization, given the consumer idle time (see BackoffStats) */
+    double format_utilization(uint64_t idle_ns) const
+    {
+        return elapsed_ns ? 1.0 - static_cast<double>(idle_ns + format_stall_ns) / elapsed_ns : 0.0;
+    }
+};
+
+/** Two stage pipeline: the consumer thread formats into one of BUFFERS page aligned buffers while
+ *  a dedicated I/O thread writes the previous ones, in order, with blocking write() calls.
+ *  A buffer is handed over at the end of each batch or when full; the consumer only waits when
+ *  all the buffers are queued for writing, so a slow disk stalls the queue drain only after that.
+ */
+class CPipelineSink
+{
+public:
+    constexpr static bool DIRECT = true;
+    constexpr static std::size_t PAGE_SIZE = 4096;
+    constexpr static unsigned int DEFAULT_BUFFERS = 4;
+    constexpr static std::size_t DEFAULT_BUFFER_SIZE = 256 * 1024;
+
+protected:
+    struct Buffer
+    {
+        char* data = {};
+        std::size_t used = {};
+    };
+
+    int m_Fd;
+    std::vector<Buffer> m_Buffers;
+    std::size_t m_Capacity;
+    /** Buffers handed to the I/O thread and buffers written so far, the one being filled is m_Submitted % size */
+    uint64_t m_Submitted;
+    uint64_t m_Written;
+    bool m_Stop;
+    std::mutex m_Mutex;
+    std::condition_variable m_Ready;
+    std::condition_variable m_Free;
+    std::thread m_IoThread;
+
+    const std::chrono::steady_clock::time_point m_Start;
+    std::atomic<uint64_t> m_Bytes;
+    std::atomic<uint64_t> m_Syscalls;
+    std::atomic<uint64_t> m_IoBusyNs;
+    std::atomic<uint64_t> m_StallNs;
+
+    inline static void _add(std::atomic<uint64_t>& counter, uint64_t value)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    /** I/O thread only */
+    void _write_all(const char* data, std::size_t size)
+    {
+        while (size > 0) {
+            const ssize_t written(::write(m_Fd, data, size));
+            _add(m_Syscalls, 1);
+            if (written < 0) {
+                if (errno == EINTR)
+                    continue;
+                return;  // Errors drop the data
+            }
+            _add(m_Bytes, written);
+            data += written;
+            size -= written;
+        }
+    }
+
+    void _io()
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        while (true) {
+            m_Ready.wait(lock, [this] () { return m_Written < m_Submitted || m_Stop; });
+            if (m_Written == m_Submitted)
+                break;  // Stopped and nothing left
+            Buffer& b(m_Buffers[m_Written % m_Buffers.size()]);
+            lock.unlock();
+
+            const auto start(std::chrono::steady_clock::now());
+            _write_all(b.data, b.used);
+            _add(m_IoBusyNs, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+            b.used = 0;
+
+            lock.lock();
+            m_Written++;
+            m_Free.notify_one();
+        }
+    }
+
+    inline Buffer& _current() { return m_Buffers[m_Submitted % m_Buffers.size()]; }
+
+    /** Hand the current buffer to the I/O thread and wait for the next one to be free */
+    void _submit()
+    {
+        if (_current().used == 0 || m_Fd < 0)
+            return;
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        m_Submitted++;
+        m_Ready.notify_one();
+        if (m_Submitted - m_Written >= m_Buffers.size()) {
+            const auto start(std::chrono::steady_clock::now());
+            m_Free.wait(lock, [this] () { return m_Submitted - m_Written < m_Buffers.size(); });
+            _add(m_StallNs, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+        }
+    }
+
+public:
+    explicit CPipelineSink(
+        const std::string& filename,
+        unsigned int buffers = DEFAULT_BUFFERS, std::size_t buffer_size = DEFAULT_BUFFER_SIZE
+    ) :
+        m_Fd(::open(filename.c_str(), O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0644)),
+        // One being filled, at least one being written
+        m_Buffers(buffers > 2 ? buffers : 2),
+        m_Capacity((buffer_size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1)),
+        m_Submitted(0), m_Written(0), m_Stop(false),
+        m_Start(std::chrono::steady_clock::now()),
+        m_Bytes(0), m_Syscalls(0), m_IoBusyNs(0), m_StallNs(0)
+    {
+        for (auto& b : m_Buffers) {
+            void* data;
+            if (posix_memalign(&data, PAGE_SIZE, m_Capacity) != 0) {
+                // Like std::ofstream, a sink that failed to set up silently discards the output
+                if (m_Fd >= 0)
+                    ::close(m_Fd);
+                m_Fd = -1;
+                break;
+            }
+            b.data = static_cast<char*>(data);
+        }
+        if (m_Fd >= 0)
+            m_IoThread = std::thread(&CPipelineSink::_io, this);
+    }
+    CPipelineSink(const CPipelineSink&) = delete;
+    CPipelineSink& operator=(const CPipelineSink&) = delete;
+    ~CPipelineSink()
+    {
+        close();
+        for (auto& b : m_Buffers)
+            std::free(b.data);
+    }
+
+    inline void write(const char* data, std::size_t size)
+    {
+        while (size > 0 && m_Fd >= 0) {
+            Buffer& b(_current());
+            const std::size_t room(m_Capacity - b.used);
+            if (room == 0) {
+                _submit();
+                continue;
+            }
+            const std::size_t chunk(size < room ? size : room);
+            std::memcpy(b.data + b.used, data, chunk);
+            b.used += chunk;
+            data += chunk;
+            size -= chunk;
+        }
+    }
+
+    /** Hands the buffer over when the room left is less than size */
+    inline char* reserve(std::size_t size)
+    {
+        if (m_Fd < 0 || size > m_Capacity)
+            return nullptr;
+        if (size > m_Capacity - _current().used)
+            _submit();
+        return _current().data + _current().used;
+    }
+    inline void commit(std::size_t size) { _current().used += size; }
+
+    /** Hand the batch to the I/O thread */
+    void flush() { _submit(); }
+
+    void close()
+    {
+        if (m_Fd < 0)
+            return;
+        _submit();
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Stop = true;
+            m_Ready.notify_one();
+        }
+        m_IoThread.join();
+        ::close(m_Fd);
+        m_Fd = -1;
+    }
+
+    bool is_open() const { return m_Fd >= 0; }
+
+    SinkStats getStats() const
+    {
+        SinkStats stats;
+        stats.bytes = m_Bytes.load(std::memory_order_relaxed);
+        stats.syscalls = m_Syscalls.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    PipelineStats getPipelineStats() const
+    {
+        PipelineStats stats;
+        stats.elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_Start).count();
+        stats.io_busy_ns = m_IoBusyNs.load(std::memory_order_relaxed);
+        stats.format_stall_ns = m_StallNs.load(std::memory_order_relaxed);
+        return stats;
+    }
+};
+
+}  // namespace rtlog
@@ -0,0 +1,30 @@
+/** \file
+ *  Transport wrapper shared by the logger and its consumers
+ */
+
+#pragma once
+
+#include "Notifier.hpp"
+#include "Overflow.hpp"
+
+namespace rtlog {
+
+/** The transport with the side state shared by the logger and its consumers */
+template<typename BASE_QUEUE>
+class CLogQueueT : public BASE_QUEUE
+{
+protected:
+    CDropCounters m_Drops;
+    CConsumerNotifier m_Notifier;
+
+public:
+    typedef BASE_QUEUE base_queue_type;
+
+    using BASE_QUEUE::BASE_QUEUE;
+
+    CDropCounters& drops() { return m_Drops; }
+    const CDropCounters& drops() const { return m_Drops; }
+    CConsumerNotifier& notifier() { return m_Notifier; }
+};
+
+}  // namespace rtlog
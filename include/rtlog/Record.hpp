@@ -0,0 +1,275 @@
+/** \file
+ *  Log message record types moved through the queue
+ */
+
+#pragma once
+
+#include <cstring>
+
+#include <chrono>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+#include "Argument.hpp"
+#include "Site.hpp"
+#include "../Traits.hpp"
+
+namespace rtlog {
+
+/** Holds a log message as a compact sequence of type tags and raw argument bytes.
+ *  Each argument takes one E_ARG_TYPE byte followed by arg_size() payload bytes, unaligned.
+ *  Dynamic strings (STRING_TYPE) are copied as a string_size_type length followed by the chars.
+ *  The message ends with an END_MARKER_TYPE tag.
+ *  A record starting with a SITE_TYPE tag instead carries untagged payloads only, whose types
+ *  are held by the CSiteRegistryT entry.
+ *  Only the used bytes are initialized and copied around, so a short message touches few cache lines;
+ *  the only limit is the overall LOGGER_TRAITS::RECORD_SIZE.
+ */
+template<typename LOGGER_TRAITS>
+class PackedRecordT
+{
+public:
+    typedef uint16_t size_type;
+    constexpr static std::size_t capacity = LOGGER_TRAITS::RECORD_SIZE - sizeof(size_type);
+
+    static_assert(LOGGER_TRAITS::RECORD_SIZE <= std::numeric_limits<size_type>::max(), "RECORD_SIZE too large");
+
+protected:
+    size_type m_Size;
+    unsigned char m_Data[capacity];
+
+    template<typename T>
+    using arg_type = ArgTypeOf<T>;
+
+    template<E_ARG_TYPE ARG_TYPE, typename T>
+    inline void _push_payload(std::size_t& pos, const T& v, std::size_t reserve) noexcept
+    {
+        if constexpr (ARG_TYPE == E_ARG_TYPE::STRING_TYPE) {
+            const auto str(string_ref(v, LOGGER_TRAITS::MAX_STRING_LENGTH));
+            // Truncate to the room left by the following arguments, guaranteed by fits()
+            const std::size_t room(capacity - pos - sizeof(string_size_type) - reserve);
+            const string_size_type length(static_cast<string_size_type>(str.second < room ? str.second : room));
+            std::memcpy(m_Data + pos, &length, sizeof(length));
+            std::memcpy(m_Data + pos + sizeof(length), str.first, length);
+            pos += sizeof(length) + length;
+        } else if constexpr (arg_size(ARG_TYPE) != 0) {
+            // Decay arrays to pointers and so on
+            const typename TypeArg<ARG_TYPE>::TYPE value(v);
+            std::memcpy(m_Data + pos, &value, arg_size(ARG_TYPE));
+            pos += arg_size(ARG_TYPE);
+        }
+        m_Size = static_cast<size_type>(pos);
+    }
+
+public:
+    PackedRecordT() noexcept : m_Size(0) {}
+    PackedRecordT(const PackedRecordT& other) noexcept : m_Size(other.m_Size)
+    { std::memcpy(m_Data, other.m_Data, m_Size); }
+    PackedRecordT& operator=(const PackedRecordT& other) noexcept
+    {
+        m_Size = other.m_Size;
+        std::memcpy(m_Data, other.m_Data, m_Size);
+        return *this;
+    }
+
+    /** Encoded size of a single argument, only the length prefix for dynamic strings */
+    template<typename T>
+    constexpr static std::size_t encoded_size() { return 1 + arg_size(arg_type<T>::ARG_TYPE); }
+    /** Minimum number of bytes taken by a message made of Args */
+    template<typename... Args>
+    constexpr static std::size_t encoded_size_of()
+    {
+        std::size_t size(0);
+        for (std::size_t s : {std::size_t(0), encoded_size<Args>()...})
+            size += s;
+        return size;
+    }
+    /** Minimum number of bytes taken by the untagged payloads of Args */
+    template<typename... Args>
+    constexpr static std::size_t raw_size_of()
+    {
+        std::size_t size(0);
+        for (std::size_t s : {std::size_t(0), arg_size(arg_type<Args>::ARG_TYPE)...})
+            size += s;
+        return size;
+    }
+    /** Check at compile time that a message made of Args fits */
+    template<typename... Args>
+    constexpr static bool fits() { return encoded_size_of<Args...>() <= capacity; }
+    /** Check at compile time that a site record made of Args fits */
+    template<typename... Args>
+    constexpr static bool fits_site() { return encoded_size<uint32_t>() + raw_size_of<Args...>() <= capacity; }
+
+    /** Encode an argument at byte offset pos and advance it.
+     *  reserve is the room to be left for the following arguments, dynamic strings are truncated accordingly.
+     */
+    template<typename T>
+    inline void push(std::size_t& pos, T&& v, std::size_t reserve = 0) noexcept
+    {
+        constexpr E_ARG_TYPE ARG_TYPE = arg_type<T>::ARG_TYPE;
+        m_Data[pos++] = static_cast<unsigned char>(ARG_TYPE);
+        _push_payload<ARG_TYPE>(pos, v, reserve);
+    }
+
+    /** Encode an argument payload without type tag at byte offset pos and advance it */
+    template<typename T>
+    inline void push_raw(std::size_t& pos, T&& v, std::size_t reserve = 0) noexcept
+    {
+        _push_payload<arg_type<T>::ARG_TYPE>(pos, v, reserve);
+    }
+
+    /** Encode the leading site ID of a site record */
+    inline void push_site(std::size_t& pos, uint32_t site) noexcept
+    {
+        m_Data[pos++] = static_cast<unsigned char>(E_ARG_TYPE::SITE_TYPE);
+        push_raw(pos, site);
+    }
+
+    /** Decode the leading site ID, if any, and advance pos */
+    inline bool pop_site(std::size_t& pos, uint32_t& site) const noexcept
+    {
+        if (m_Size == 0 || static_cast<E_ARG_TYPE>(m_Data[pos]) != E_ARG_TYPE::SITE_TYPE)
+            return false;
+        std::memcpy(&site, m_Data + pos + 1, sizeof(site));
+        pos += 1 + sizeof(site);
+        return true;
+    }
+
+    /** Decode an untagged payload of the given type at byte offset pos and advance it */
+    inline void pop_raw(std::size_t& pos, E_ARG_TYPE type, Argument& arg) const noexcept
+    {
+        if (type == E_ARG_TYPE::STRING_TYPE) {
+            // Refer to the copy inside the record
+            string_size_type length;
+            std::memcpy(&length, m_Data + pos, sizeof(length));
+            arg.assign_string(reinterpret_cast<const char*>(m_Data + pos));
+            pos += sizeof(length) + length;
+        } else {
+            arg.assign(type, m_Data + pos);
+            pos += arg_size(type);
+        }
+    }
+
+    /** Decode the argument at byte offset pos and advance it.
+     *  \return false at the end of the record
+     */
+    inline bool pop(std::size_t& pos, Argument& arg) const noexcept
+    {
+        if (pos >= m_Size)
+            return false;
+        const E_ARG_TYPE type(static_cast<E_ARG_TYPE>(m_Data[pos++]));
+        pop_raw(pos, type, arg);
+        return true;
+    }
+
+    inline std::size_t size() const noexcept { return m_Size; }
+    inline bool empty() const noexcept { return m_Size == 0; }
+};
+
+/** Nanoseconds since the epoch of a time point argument, see USE_TIMEPOINT */
+inline bool time_ns(const Argument& arg, int64_t& ns) noexcept
+{
+    if (arg.type() == E_ARG_TYPE::TIMEPOINT_TYPE)
+        ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            arg.get<E_ARG_TYPE::TIMEPOINT_TYPE>().time_since_epoch()
+        ).count();
+    else if (arg.type() == E_ARG_TYPE::TSC_TIMEPOINT_TYPE)
+        ns = CTscCalibration::get().to_ns(arg.get<E_ARG_TYPE::TSC_TIMEPOINT_TYPE>().time_since_epoch().count());
+    else
+        return false;
+    return true;
+}
+
+/** Current time in the clock of RTLOG_NOW(), comparable with record_time() */
+inline int64_t record_clock_ns() noexcept
+{
+#if defined(USE_TSC_CLOCK)
+    return CTscCalibration::get().to_ns(tsc_clock::ticks());
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::high_resolution_clock::now().time_since_epoch()
+    ).count();
+#endif
+}
+
+/** Time stamp of a record enqueued with USE_TIMEPOINT, in nanoseconds since the epoch.
+ *  \return false if the record does not start with a time point
+ */
+template<typename LOGGER_TRAITS>
+bool record_time(const ArgumentArrayT<LOGGER_TRAITS>& record, int64_t& ns) noexcept
+{
+    return time_ns(record[0], ns);
+}
+
+template<typename LOGGER_TRAITS>
+bool record_time(const PackedRecordT<LOGGER_TRAITS>& record, int64_t& ns) noexcept
+{
+    std::size_t pos = {};
+    uint32_t site_id;
+    Argument arg;
+    if (record.pop_site(pos, site_id)) {
+        const LogSite& site(CSiteRegistryT<LOGGER_TRAITS>::get(site_id));
+        if (site.count == 0)
+            return false;
+        record.pop_raw(pos, site.types[0], arg);
+    }
+    else if (!record.pop(pos, arg))
+        return false;
+    return time_ns(arg, ns);
+}
+
+/** Level carried by an argument, as a LogLevel value or a level type */
+inline bool level_of(const Argument& arg, LogLevel& level) noexcept
+{
+    switch (arg.type()) {
+        case E_ARG_TYPE::LOG_LEVEL_TYPE: level = arg.get<E_ARG_TYPE::LOG_LEVEL_TYPE>(); return true;
+        case E_ARG_TYPE::LOG_INFO_TYPE: level = LogLevel::INFO; return true;
+        case E_ARG_TYPE::LOG_WARN_TYPE: level = LogLevel::WARN; return true;
+        case E_ARG_TYPE::LOG_CRIT_TYPE: level = LogLevel::CRIT; return true;
+        default: return false;
+    }
+}
+
+/** Number of leading values searched for the level: time point, thread ID, level */
+constexpr std::size_t RECORD_LEVEL_SEARCH = 3;
+
+/** Level of a record, from the site or among its leading values.
+ *  \return false if the record carries none
+ */
+template<typename LOGGER_TRAITS>
+bool record_level(const ArgumentArrayT<LOGGER_TRAITS>& record, LogLevel& level) noexcept
+{
+    for (std::size_t i = {}; i < RECORD_LEVEL_SEARCH && i < record.size(); i++) {
+        if (level_of(record[i], level))
+            return true;
+    }
+    return false;
+}
+
+template<typename LOGGER_TRAITS>
+bool record_level(const PackedRecordT<LOGGER_TRAITS>& record, LogLevel& level) noexcept
+{
+    std::size_t pos = {};
+    uint32_t site_id;
+    if (record.pop_site(pos, site_id)) {
+        level = CSiteRegistryT<LOGGER_TRAITS>::get(site_id).level;
+        return true;
+    }
+    Argument arg;
+    for (std::size_t i = {}; i < RECORD_LEVEL_SEARCH && record.pop(pos, arg); i++) {
+        if (level_of(arg, level))
+            return true;
+    }
+    return false;
+}
+
+/** Record type selected by LOGGER_TRAITS::PACKED_RECORD */
+template<typename LOGGER_TRAITS>
+using RecordT = typename std::conditional<
+    LOGGER_TRAITS::PACKED_RECORD,
+    PackedRecordT<LOGGER_TRAITS>,
+    ArgumentArrayT<LOGGER_TRAITS>
+>::type;
+
+}  // namespace rtlog
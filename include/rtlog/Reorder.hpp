@@ -0,0 +1,142 @@
+/** \file
+ *  Bounded reordering of records by time stamp
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Record.hpp"
+
+namespace rtlog {
+
+/** Holds up to capacity records in a min-heap keyed by time stamp (see record_time()) so that they
+ *  leave in time order even though the queue hands them over interleaved by producer.
+ *  A record leaves when the window is full, or when it is older than the newest record seen by
+ *  more than delay; a zero delay bounds the window by record count only.
+ *  Records arriving after a younger one already left cannot be put back in order: they are counted
+ *  as late and leave first. Records without a time stamp take the newest time seen.
+ *  Storage is allocated once, consumer thread only except for late().
+ */
+template<typename RECORD>
+class CReorderWindowT
+{
+protected:
+    struct Entry
+    {
+        int64_t time;
+        /** Arrival order, keeps records with the same time stamp in queue order */
+        uint64_t sequence;
+        uint32_t slot;
+
+        /** Reversed, std heaps are max-heaps */
+        bool operator<(const Entry& other) const
+        { return time > other.time || (time == other.time && sequence > other.sequence); }
+    };
+
+    const std::size_t m_Capacity;
+    const int64_t m_DelayNs;
+    std::unique_ptr<RECORD[]> m_Records;
+    std::vector<uint32_t> m_Free;
+    std::vector<Entry> m_Heap;
+    uint64_t m_Sequence;
+    int64_t m_Newest;
+    int64_t m_LastEmitted;
+    std::atomic<uint64_t> m_Late;
+
+    template<typename WRITE>
+    inline void _pop(WRITE&& write)
+    {
+        std::pop_heap(m_Heap.begin(), m_Heap.end());
+        const Entry entry(m_Heap.back());
+        m_Heap.pop_back();
+        m_LastEmitted = entry.time;
+        write(m_Records[entry.slot]);
+        m_Free.push_back(entry.slot);
+    }
+
+public:
+    CReorderWindowT(std::size_t capacity, std::chrono::nanoseconds delay) :
+        m_Capacity(capacity),
+        m_DelayNs(delay.count()),
+        m_Records(capacity ? new RECORD[capacity] : nullptr),
+        m_Sequence(0),
+        m_Newest(INT64_MIN), m_LastEmitted(INT64_MIN),
+        m_Late(0)
+    {
+        m_Free.reserve(capacity);
+        m_Heap.reserve(capacity);
+        for (std::size_t i = capacity; i > 0; i--)
+            m_Free.push_back(static_cast<uint32_t>(i - 1));
+    }
+    CReorderWindowT(const CReorderWindowT&) = delete;
+    CReorderWindowT& operator=(const CReorderWindowT&) = delete;
+
+    /** Add a record, making room first through write(RECORD&) if the window is full.
+     *  record can be of any type RECORD is assignable from and record_time() accepts.
+     */
+    template<typename R, typename WRITE>
+    void push(const R& record, WRITE&& write)
+    {
+        if (m_Heap.size() == m_Capacity)
+            _pop(write);
+        int64_t time;
+        if (!record_time(record, time))
+            time = m_Newest;
+        if (time < m_LastEmitted)
+            m_Late.store(m_Late.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (time > m_Newest)
+            m_Newest = time;
+
+        const uint32_t slot(m_Free.back());
+        m_Free.pop_back();
+        m_Records[slot] = record;
+        m_Heap.push_back(Entry{time, m_Sequence++, slot});
+        std::push_heap(m_Heap.begin(), m_Heap.end());
+    }
+
+    /** Emit the records older than the newest one by more than the delay */
+    template<typename WRITE>
+    void pop(WRITE&& write)
+    {
+        if (m_DelayNs == 0 || m_Newest == INT64_MIN)
+            return;
+        while (!m_Heap.empty() && m_Heap.front().time < m_Newest - m_DelayNs)
+            _pop(write);
+    }
+
+    /** The queue is idle: emit the records older than now by more than the delay, all of them without one.
+     *  \return false if none left
+     */
+    template<typename WRITE>
+    bool expire(int64_t now_ns, WRITE&& write)
+    {
+        bool emitted(false);
+        while (!m_Heap.empty() && (m_DelayNs == 0 || m_Heap.front().time < now_ns - m_DelayNs)) {
+            _pop(write);
+            emitted = true;
+        }
+        return emitted;
+    }
+
+    /** Emit everything, e.g. when stopping */
+    template<typename WRITE>
+    void drain(WRITE&& write)
+    {
+        while (!m_Heap.empty())
+            _pop(write);
+    }
+
+    std::size_t size() const { return m_Heap.size(); }
+    bool empty() const { return m_Heap.empty(); }
+    std::size_t capacity() const { return m_Capacity; }
+    /** Records that arrived after a younger one had been emitted, callable from any thread */
+    uint64_t late() const { return m_Late.load(std::memory_order_relaxed); }
+};
+
+}  // namespace rtlog
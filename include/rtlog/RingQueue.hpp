@@ -0,0 +1,239 @@
+/** \file
+ *  Per thread single producer/single consumer rings, alternative transport to moodycamel::ConcurrentQueue
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace rtlog {
+
+/** A set of bounded lock-free rings, one owned by each producer thread, drained round robin by a single consumer.
+ *  Producers never contend with each other and enqueue/dequeue need no atomic read-modify-write:
+ *  only a thread's first enqueue claims a ring.
+ *  Same construction and try_enqueue/try_dequeue interface as moodycamel::ConcurrentQueue so that
+ *  it can be used as the QUEUE template parameter of CLoggerT.
+ *  Only one consumer thread at a time is supported.
+ */
+template<typename T, typename QUEUE_TRAITS>
+class CRingQueueT
+{
+public:
+    typedef T value_type;
+    constexpr static std::size_t CACHE_LINE_SIZE = 64;
+    /** Enqueues a thread without a ring drops before it looks for a free one again */
+    constexpr static uint32_t CLAIM_RETRY = 1024;
+
+protected:
+    /** Bounded single producer single consumer ring, producer and consumer indexes on separate cache lines */
+    struct Ring
+    {
+        // Producer side
+        alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> tail = {};
+        std::size_t cached_head = {};
+        // Consumer side
+        alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> head = {};
+        std::size_t cached_tail = {};
+        // Rarely written
+        alignas(CACHE_LINE_SIZE) std::atomic<bool> owned = {};
+        std::size_t mask = {};
+        std::unique_ptr<T[]> slots;
+    };
+
+    /** Rings storage, shared with the producer threads so that it's still valid when a thread
+     *  exits after the queue is gone
+     */
+    struct State
+    {
+        std::unique_ptr<Ring[]> rings;
+        std::size_t count = {};
+        /** Rings [0, active) have been claimed at least once */
+        std::atomic<std::size_t> active = {};
+    };
+
+    /** Per thread cached ring, released when the thread exits; null if none was free at the last claim */
+    struct ThreadRing
+    {
+        uint64_t generation = {};
+        Ring* ring = {};
+        std::weak_ptr<State> state;
+        /** Failed enqueues since the last claim without a ring */
+        uint32_t misses = {};
+
+        void release()
+        {
+            auto s = state.lock();
+            if (s && ring)
+                ring->owned.store(false, std::memory_order_release);
+            ring = nullptr;
+            state.reset();
+        }
+        ~ThreadRing() { release(); }
+    };
+
+    const uint64_t m_Generation;
+    std::shared_ptr<State> m_State;
+    // Consumer round robin position
+    std::size_t m_Next;
+    std::size_t m_Burst;
+
+    static std::atomic<uint64_t> s_Generation;
+
+    inline Ring* _claim()
+    {
+        for (std::size_t i = {}; i < m_State->count; i++) {
+            Ring& ring(m_State->rings[i]);
+            if (!ring.owned.load(std::memory_order_relaxed) && !ring.owned.exchange(true, std::memory_order_acq_rel)) {
+                std::size_t active(m_State->active.load(std::memory_order_relaxed));
+                while (active <= i && !m_State->active.compare_exchange_weak(active, i + 1, std::memory_order_release));
+                return &ring;
+            }
+        }
+        return nullptr;  // All rings taken
+    }
+
+    /** Thread local ring for this queue, claimed on first use by each thread */
+    inline Ring* _thread_ring()
+    {
+        static thread_local ThreadRing cache;
+        if (cache.generation != m_Generation || (!cache.ring && ++cache.misses >= CLAIM_RETRY)) {
+            // First message from this thread or a different queue instance, or a new try after all rings were taken
+            cache.release();
+            cache.ring = _claim();
+            cache.misses = 0;
+            cache.state = m_State;
+            cache.generation = m_Generation;
+        }
+        return cache.ring;
+    }
+
+    inline bool _pop(Ring& ring, T& item)
+    {
+        const std::size_t head(ring.head.load(std::memory_order_relaxed));
+        if (head == ring.cached_tail) {
+            ring.cached_tail = ring.tail.load(std::memory_order_acquire);
+            if (head == ring.cached_tail)
+                return false;
+        }
+        item = std::move(ring.slots[head & ring.mask]);
+        ring.head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Pop up to max items from a ring with a single head update */
+    template<typename It>
+    inline std::size_t _pop_bulk(Ring& ring, It& items, std::size_t max)
+    {
+        const std::size_t head(ring.head.load(std::memory_order_relaxed));
+        if (ring.cached_tail - head < max)
+            ring.cached_tail = ring.tail.load(std::memory_order_acquire);
+        std::size_t count(ring.cached_tail - head);
+        if (count > max)
+            count = max;
+        for (std::size_t i = {}; i < count; i++, ++items)
+            *items = std::move(ring.slots[(head + i) & ring.mask]);
+        if (count)
+            ring.head.store(head + count, std::memory_order_release);
+        return count;
+    }
+
+public:
+    /** Same signature as the moodycamel::ConcurrentQueue preallocating constructor.
+     *  min_capacity is the size of each ring, rounded up to a power of 2, one ring for each producer.
+     */
+    CRingQueueT(std::size_t min_capacity, std::size_t max_explicit_producers, std::size_t max_implicit_producers) :
+        m_Generation(++s_Generation), m_State(std::make_shared<State>()), m_Next(0), m_Burst(0)
+    {
+        std::size_t capacity(1);
+        while (capacity < min_capacity)
+            capacity <<= 1;
+
+        m_State->count = max_explicit_producers > max_implicit_producers ? max_explicit_producers : max_implicit_producers;
+        m_State->rings.reset(new Ring[m_State->count]);
+        for (std::size_t i = {}; i < m_State->count; i++) {
+            m_State->rings[i].mask = capacity - 1;
+            m_State->rings[i].slots.reset(new T[capacity]);
+        }
+    }
+    CRingQueueT(const CRingQueueT&) = delete;
+    CRingQueueT& operator=(const CRingQueueT&) = delete;
+
+    /** Enqueue on the calling thread's ring, fails if the ring is full or no ring is available */
+    inline bool try_enqueue(T&& item)
+    {
+        Ring* ring(_thread_ring());
+        if (!ring)
+            return false;
+
+        const std::size_t tail(ring->tail.load(std::memory_order_relaxed));
+        if (tail - ring->cached_head > ring->mask) {
+            ring->cached_head = ring->head.load(std::memory_order_acquire);
+            if (tail - ring->cached_head > ring->mask)
+                return false;  // Full
+        }
+        ring->slots[tail & ring->mask] = std::move(item);
+        ring->tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Dequeue from the rings round robin, moving to the next ring after BLOCK_SIZE consecutive items */
+    bool try_dequeue(T& item)
+    {
+        const std::size_t active(m_State->active.load(std::memory_order_acquire));
+        for (std::size_t n = {}; n < active; n++) {
+            if (m_Next >= active)
+                m_Next = 0;
+            if (_pop(m_State->rings[m_Next], item)) {
+                if (++m_Burst >= QUEUE_TRAITS::BLOCK_SIZE) {
+                    m_Burst = 0;
+                    m_Next++;
+                }
+                return true;
+            }
+            m_Burst = 0;
+            m_Next++;
+        }
+        return false;
+    }
+
+    /** Dequeue up to max items, same round robin as try_dequeue */
+    template<typename It>
+    std::size_t try_dequeue_bulk(It items, std::size_t max)
+    {
+        std::size_t count = {};
+        const std::size_t active(m_State->active.load(std::memory_order_acquire));
+        for (std::size_t n = {}; n < active && count < max; n++) {
+            if (m_Next >= active)
+                m_Next = 0;
+            const std::size_t burst(QUEUE_TRAITS::BLOCK_SIZE - m_Burst);
+            const std::size_t popped(_pop_bulk(m_State->rings[m_Next], items, max - count < burst ? max - count : burst));
+            count += popped;
+            m_Burst += popped;
+            if (popped == 0 || m_Burst >= QUEUE_TRAITS::BLOCK_SIZE) {
+                m_Burst = 0;
+                m_Next++;
+            }
+        }
+        return count;
+    }
+
+    /** Approximate number of enqueued items */
+    std::size_t size_approx() const
+    {
+        std::size_t size = {};
+        const std::size_t active(m_State->active.load(std::memory_order_acquire));
+        for (std::size_t i = {}; i < active; i++) {
+            const std::size_t head(m_State->rings[i].head.load(std::memory_order_acquire));
+            size += m_State->rings[i].tail.load(std::memory_order_acquire) - head;
+        }
+        return size;
+    }
+};
+
+template<typename T, typename QUEUE_TRAITS>
+std::atomic<uint64_t> CRingQueueT<T, QUEUE_TRAITS>::s_Generation;
+
+}  // namespace rtlog
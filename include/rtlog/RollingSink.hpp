@@ -0,0 +1,247 @@
+/** \file
+ *  Rolling files output sink
+ */
+
+#pragma once
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Sink.hpp"
+
+namespace rtlog {
+
+/** Buffered fd sink writing to <prefix>.1.txt, <prefix>.2.txt, ... switching file when the current one
+ *  reaches roll_bytes or has been open for roll_interval, always at a line boundary.
+ *  A housekeeping thread creates the next file ahead of time under a temporary name and preallocates
+ *  roll_bytes with fallocate; it also renames the new file and fsyncs and closes the old one after a
+ *  roll, so on the consumer thread the roll is just a buffer write and an fd swap.
+ */
+class CRollingSink : public CFdSink
+{
+public:
+    constexpr static uint64_t DEFAULT_ROLL_BYTES = 64 * 1024 * 1024;
+    /** Lines written between time based roll checks */
+    constexpr static unsigned int TIME_CHECK_WRITES = 64;
+
+protected:
+    const std::string m_Prefix;
+    const uint64_t m_RollBytes;
+    const std::chrono::seconds m_RollInterval;
+    /** Current file number and size */
+    unsigned int m_Index;
+    uint64_t m_FileBytes;
+    std::chrono::steady_clock::time_point m_FileStart;
+    /** Writes since the last look at the clock */
+    unsigned int m_Writes;
+
+    // Housekeeping thread
+    std::mutex m_Mutex;
+    std::condition_variable m_Work;
+    std::condition_variable m_Prepared;
+    std::thread m_Thread;
+    bool m_Stop;
+    /** Next file, valid when m_NextReady; -1 if it could not be created */
+    unsigned int m_NextIndex;
+    int m_NextFd;
+    bool m_NextReady;
+    /** Files to be renamed to their final name, and fds to be synced and closed */
+    std::vector<unsigned int> m_Renames;
+    std::vector<int> m_Retired;
+
+    std::atomic<uint64_t> m_Rolls;
+    std::atomic<uint64_t> m_RollStalls;
+
+    std::string _name(unsigned int index) const { return m_Prefix + "." + std::to_string(index) + ".txt"; }
+    std::string _next_name(unsigned int index) const { return _name(index) + ".next"; }
+
+    static int _create(const std::string& filename)
+    {
+        return ::open(filename.c_str(), O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0644);
+    }
+
+    void _housekeeping()
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        while (true) {
+            m_Work.wait(lock, [this] () { return m_Stop || !m_NextReady || !m_Renames.empty() || !m_Retired.empty(); });
+            std::vector<unsigned int> renames;
+            std::vector<int> retired;
+            renames.swap(m_Renames);
+            retired.swap(m_Retired);
+            const bool prepare(!m_NextReady && !m_Stop);
+            const unsigned int index(m_NextIndex);
+            const bool stop(m_Stop);
+            lock.unlock();
+
+            for (unsigned int i : renames)
+                ::rename(_next_name(i).c_str(), _name(i).c_str());
+            for (int fd : retired) {
+                // Release the preallocated blocks past the end
+                struct stat st;
+                if (::fstat(fd, &st) == 0)
+                    ::ftruncate(fd, st.st_size);
+                ::fsync(fd);
+                ::close(fd);
+            }
+            int fd(-1);
+            if (prepare) {
+                fd = _create(_next_name(index));
+#if defined(__linux__)
+                // Reserve the blocks without changing the file size
+                if (fd >= 0)
+                    ::fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(m_RollBytes));
+#endif
+            }
+
+            lock.lock();
+            if (prepare) {
+                m_NextFd = fd;
+                m_NextReady = true;
+                m_Prepared.notify_one();
+            }
+            if (stop && m_Renames.empty() && m_Retired.empty())
+                break;
+        }
+        // Prepared file never used
+        if (m_NextReady && m_NextFd >= 0) {
+            ::close(m_NextFd);
+            ::unlink(_next_name(m_NextIndex).c_str());
+        }
+    }
+
+    /** Switch to the next file */
+    void _roll()
+    {
+        CFdSink::flush();
+        int fd;
+        bool rename(true);
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            if (!m_NextReady) {
+                // Rolling faster than the next file can be prepared
+                m_RollStalls.store(m_RollStalls.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                m_Prepared.wait(lock, [this] () { return m_NextReady; });
+            }
+            fd = m_NextFd;
+            if (fd < 0) {
+                // Try once more with the final name
+                fd = _create(_name(m_NextIndex));
+                rename = false;
+                if (fd < 0) {
+                    // Keep going on the current file, retry after another roll_bytes or roll_interval
+                    m_NextReady = false;
+                    m_Work.notify_one();
+                    m_FileBytes = 0;
+                    m_FileStart = std::chrono::steady_clock::now();
+                    return;
+                }
+            }
+            if (rename)
+                m_Renames.push_back(m_NextIndex);
+            if (m_Fd >= 0)
+                m_Retired.push_back(m_Fd);
+            m_Index = m_NextIndex;
+            m_NextIndex = m_Index + 1;
+            m_NextReady = false;
+            m_Work.notify_one();
+        }
+        m_Fd = fd;
+        m_FileBytes = 0;
+        m_FileStart = std::chrono::steady_clock::now();
+        m_Rolls.store(m_Rolls.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    /** Current file open for roll_interval, and not empty */
+    inline bool _expired() const
+    {
+        return m_RollInterval.count() && m_FileBytes && std::chrono::steady_clock::now() - m_FileStart >= m_RollInterval;
+    }
+
+    inline void _appended(std::size_t size)
+    {
+        m_FileBytes += size;
+        if (m_FileBytes >= m_RollBytes)
+            _roll();
+        // The clock is read once every TIME_CHECK_WRITES lines, flush() covers the idle periods
+        else if (m_RollInterval.count() && ++m_Writes >= TIME_CHECK_WRITES) {
+            m_Writes = 0;
+            if (_expired())
+                _roll();
+        }
+    }
+
+public:
+    /** prefix is the directory and root of the file names, roll_interval 0 disables time based rolls */
+    explicit CRollingSink(
+        const std::string& prefix,
+        uint64_t roll_bytes = DEFAULT_ROLL_BYTES,
+        std::chrono::seconds roll_interval = std::chrono::seconds(0),
+        std::size_t buffer_size = DEFAULT_BUFFER_SIZE
+    ) :
+        CFdSink(_create(prefix + ".1.txt"), buffer_size),
+        m_Prefix(prefix), m_RollBytes(roll_bytes ? roll_bytes : DEFAULT_ROLL_BYTES), m_RollInterval(roll_interval),
+        m_Index(1), m_FileBytes(0), m_FileStart(std::chrono::steady_clock::now()), m_Writes(0),
+        m_Stop(false), m_NextIndex(2), m_NextFd(-1), m_NextReady(false),
+        m_Rolls(0), m_RollStalls(0)
+    {
+        m_Thread = std::thread(&CRollingSink::_housekeeping, this);
+    }
+    ~CRollingSink() { close(); }
+
+    inline void write(const char* data, std::size_t size)
+    {
+        CFdSink::write(data, size);
+        _appended(size);
+    }
+
+    inline char* reserve(std::size_t size) { return CFdSink::reserve(size); }
+    inline void commit(std::size_t size)
+    {
+        CFdSink::commit(size);
+        _appended(size);
+    }
+
+    /** End of a batch, time based rolls are checked here too */
+    void flush()
+    {
+        if (_expired())
+            _roll();
+        CFdSink::flush();
+    }
+
+    void close()
+    {
+        if (!m_Thread.joinable())
+            return;
+        CFdSink::flush();
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            if (m_Fd >= 0)
+                m_Retired.push_back(m_Fd);
+            m_Stop = true;
+            m_Work.notify_one();
+        }
+        m_Fd = -1;
+        m_Thread.join();
+    }
+
+    /** Number of the file being written */
+    unsigned int index() const { return m_Index; }
+    /** Files switched so far */
+    uint64_t rolls() const { return m_Rolls.load(std::memory_order_relaxed); }
+    /** Rolls that had to wait for the next file to be created */
+    uint64_t rollStalls() const { return m_RollStalls.load(std::memory_order_relaxed); }
+};
+
+}  // namespace rtlog
@@ -0,0 +1,265 @@
+/** \file
+ *  Output sinks, where the consumer writes formatted lines
+ */
+
+#pragma once
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+namespace rtlog {
+
+/** Output counters of a sink */
+struct SinkStats
+{
+    uint64_t bytes = {};
+    uint64_t syscalls = {};
+
+    double bytes_per_syscall() const { return syscalls ? static_cast<double>(bytes) / syscalls : 0.0; }
+};
+
+/** Sinks are the SINK template parameter of CLogConsumerSingleFileT, constructed from the file name.
+ *  Interface:
+ *      void write(const char* data, std::size_t size);  // Append a formatted line
+ *      void flush();                                   // End of a consumer batch
+ *      void close();
+ *      SinkStats getStats() const;                     // Callable from any thread
+ *  Sinks with DIRECT set also let the formatter write in their buffer:
+ *      char* reserve(std::size_t size);                // Room for size chars, nullptr if unbuffered
+ *      void commit(std::size_t size);                  // Append size chars written at reserve()
+ *  Sinks with LEVELS set are given the record level, and only the records they accept are formatted:
+ *      bool accepts(LogLevel level) const;
+ *      void write(const char* data, std::size_t size, LogLevel level);
+ */
+
+/** LEVELS of a sink, false if not declared */
+template<typename SINK, typename = void>
+struct sink_levels : std::false_type {};
+template<typename SINK>
+struct sink_levels<SINK, std::void_t<decltype(SINK::LEVELS)>> : std::integral_constant<bool, SINK::LEVELS> {};
+
+/** std::ofstream sink, flushed after each batch */
+class CStreamSink
+{
+public:
+    constexpr static bool DIRECT = false;
+
+protected:
+    std::ofstream m_Stream;
+    std::atomic<uint64_t> m_Bytes;
+
+public:
+    explicit CStreamSink(const std::string& filename) :
+        m_Stream(filename, std::ofstream::binary|std::ofstream::trunc|std::ofstream::out),
+        m_Bytes(0)
+    {}
+
+    inline void write(const char* data, std::size_t size)
+    {
+        m_Stream.write(data, size);
+        m_Bytes.store(m_Bytes.load(std::memory_order_relaxed) + size, std::memory_order_relaxed);
+    }
+    void flush() { m_Stream.flush(); }
+    void close() { m_Stream.close(); }
+
+    /** System calls are made by the stream buffer and not counted */
+    SinkStats getStats() const
+    {
+        SinkStats stats;
+        stats.bytes = m_Bytes.load(std::memory_order_relaxed);
+        return stats;
+    }
+};
+
+/** Raw file descriptor sink.
+ *  Lines are appended to a page aligned buffer written with a single write() per batch,
+ *  or a single writev() when a line does not fit in the room left.
+ */
+class CFdSink
+{
+public:
+    constexpr static bool DIRECT = true;
+    constexpr static std::size_t PAGE_SIZE = 4096;
+    constexpr static std::size_t DEFAULT_BUFFER_SIZE = 1 << 20;
+
+protected:
+    int m_Fd;
+    char* m_Buffer;
+    std::size_t m_Capacity;
+    std::size_t m_Used;
+    std::atomic<uint64_t> m_Bytes;
+    std::atomic<uint64_t> m_Syscalls;
+
+    inline void _count(std::size_t bytes)
+    {
+        m_Bytes.store(m_Bytes.load(std::memory_order_relaxed) + bytes, std::memory_order_relaxed);
+        m_Syscalls.store(m_Syscalls.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    /** writev() all of iov, retrying on partial writes and EINTR; errors drop the data */
+    void _write_all(struct iovec* iov, int count)
+    {
+        while (count > 0) {
+            const ssize_t written(::writev(m_Fd, iov, count));
+            if (written < 0) {
+                if (errno == EINTR)
+                    continue;
+                return;
+            }
+            _count(written);
+            std::size_t left(written);
+            while (count > 0 && left >= iov->iov_len) {
+                left -= iov->iov_len;
+                iov++;
+                count--;
+            }
+            if (count > 0) {
+                iov->iov_base = static_cast<char*>(iov->iov_base) + left;
+                iov->iov_len -= left;
+            }
+        }
+    }
+
+    /** Take ownership of an already open fd */
+    CFdSink(int fd, std::size_t buffer_size) :
+        m_Fd(fd),
+        m_Buffer(nullptr),
+        m_Capacity((buffer_size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1)),
+        m_Used(0), m_Bytes(0), m_Syscalls(0)
+    {
+        // Like std::ofstream, a sink that failed to open silently discards the output
+        void* buffer;
+        if (posix_memalign(&buffer, PAGE_SIZE, m_Capacity) == 0)
+            m_Buffer = static_cast<char*>(buffer);
+        else
+            m_Capacity = 0;  // Unbuffered
+    }
+
+public:
+    explicit CFdSink(const std::string& filename, std::size_t buffer_size = DEFAULT_BUFFER_SIZE) :
+        CFdSink(::open(filename.c_str(), O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0644), buffer_size)
+    {}
+    CFdSink(const CFdSink&) = delete;
+    CFdSink& operator=(const CFdSink&) = delete;
+    ~CFdSink()
+    {
+        close();
+        std::free(m_Buffer);
+    }
+
+    inline void write(const char* data, std::size_t size)
+    {
+        if (size <= m_Capacity - m_Used) {
+            std::memcpy(m_Buffer + m_Used, data, size);
+            m_Used += size;
+            return;
+        }
+        // Buffered data and the line together
+        struct iovec iov[2] = { { m_Buffer, m_Used }, { const_cast<char*>(data), size } };
+        _write_all(m_Used ? iov : iov + 1, m_Used ? 2 : 1);
+        m_Used = 0;
+    }
+
+    /** Writes the buffer out when the room left is less than size */
+    inline char* reserve(std::size_t size)
+    {
+        if (size > m_Capacity - m_Used) {
+            flush();
+            if (size > m_Capacity)
+                return nullptr;
+        }
+        return m_Buffer + m_Used;
+    }
+    inline void commit(std::size_t size) { m_Used += size; }
+
+    bool is_open() const { return m_Fd >= 0; }
+
+    void flush()
+    {
+        if (m_Used == 0)
+            return;
+        struct iovec iov = { m_Buffer, m_Used };
+        _write_all(&iov, 1);
+        m_Used = 0;
+    }
+
+    void close()
+    {
+        if (m_Fd < 0)
+            return;
+        flush();
+        ::close(m_Fd);
+        m_Fd = -1;
+    }
+
+    SinkStats getStats() const
+    {
+        SinkStats stats;
+        stats.bytes = m_Bytes.load(std::memory_order_relaxed);
+        stats.syscalls = m_Syscalls.load(std::memory_order_relaxed);
+        return stats;
+    }
+};
+
+/** Standard output sink, on a duplicate of the descriptor so that close() leaves stdout open */
+class CStdoutSink : public CFdSink
+{
+public:
+    constexpr static std::size_t DEFAULT_BUFFER_SIZE = 64 * 1024;
+
+    /** The file name is ignored, for use as the SINK of a consumer */
+    explicit CStdoutSink(const std::string& = std::string(), std::size_t buffer_size = DEFAULT_BUFFER_SIZE) :
+        CFdSink(::dup(STDOUT_FILENO), buffer_size)
+    {}
+};
+
+/** Sink interface with virtual calls, to hold sinks of different types together (see CFanOutSinkT) */
+class CSinkBase
+{
+public:
+    virtual ~CSinkBase() {}
+    virtual void write(const char* data, std::size_t size) = 0;
+    virtual void flush() = 0;
+    virtual void close() = 0;
+    virtual SinkStats getStats() const = 0;
+};
+
+/** Any SINK behind the CSinkBase interface */
+template<typename SINK>
+class CSinkT : public CSinkBase
+{
+protected:
+    SINK m_Sink;
+
+public:
+    template<typename... Args>
+    explicit CSinkT(Args&&... args) : m_Sink(std::forward<Args>(args)...) {}
+
+    virtual void write(const char* data, std::size_t size) override { m_Sink.write(data, size); }
+    virtual void flush() override { m_Sink.flush(); }
+    virtual void close() override { m_Sink.close(); }
+    virtual SinkStats getStats() const override { return m_Sink.getStats(); }
+
+    SINK& get() { return m_Sink; }
+};
+
+/** Create a SINK behind the CSinkBase interface */
+template<typename SINK, typename... Args>
+std::unique_ptr<CSinkBase> make_sink(Args&&... args)
+{
+    return std::unique_ptr<CSinkBase>(new CSinkT<SINK>(std::forward<Args>(args)...));
+}
+
+}  // namespace rtlog
@@ -0,0 +1,83 @@
+/** \file
+ *  Static registry of log statements
+ */
+
+#pragma once
+
+#include <atomic>
+#include <type_traits>
+
+#include "Argument.hpp"
+#include "Levels.hpp"
+#include "../Traits.hpp"
+
+namespace rtlog {
+
+/** Static description of a log statement, registered once by each RTLOG() expansion */
+struct LogSite
+{
+    const char* file;
+    unsigned int line;
+    /** Preformatted "[file:line]" string */
+    const char* position;
+    LogLevel level;
+    /** Type of each enqueued value, in enqueue order */
+    const E_ARG_TYPE* types = nullptr;
+    std::size_t count = 0;
+    /** Number of leading values (time point, thread ID) to be formatted before level and position */
+    std::size_t prefix = 0;
+};
+
+/** Compile time list of the E_ARG_TYPE of Args */
+template<typename... Args>
+struct ArgTypeList
+{
+    constexpr static E_ARG_TYPE types[] = {
+        ArgTypeOf<Args>::ARG_TYPE...
+    };
+};
+
+/** Fixed size registry of log sites, shared by all the loggers with the same traits.
+ *  Sites are registered by producers and read back by the consumer when formatting: a record
+ *  carrying a site ID is enqueued only after its registration so the queue itself orders the accesses.
+ */
+template<typename LOGGER_TRAITS>
+class CSiteRegistryT
+{
+public:
+    typedef uint32_t site_id;
+    constexpr static site_id INVALID_SITE = ~site_id(0);
+    constexpr static std::size_t max_sites = LOGGER_TRAITS::MAX_LOG_SITES;
+
+    /** Register a site, returns INVALID_SITE when the registry is full */
+    static site_id add(const LogSite& site, const E_ARG_TYPE* types, std::size_t count, std::size_t prefix) noexcept
+    {
+        const site_id id(s_Count.fetch_add(1, std::memory_order_relaxed));
+        if (id >= max_sites)
+            return INVALID_SITE;
+        s_Sites[id] = site;
+        s_Sites[id].types = types;
+        s_Sites[id].count = count;
+        s_Sites[id].prefix = prefix;
+        return id;
+    }
+
+    static const LogSite& get(site_id id) noexcept { return s_Sites[id]; }
+
+    static std::size_t size() noexcept
+    {
+        const std::size_t count(s_Count.load(std::memory_order_relaxed));
+        return count < max_sites ? count : max_sites;
+    }
+
+private:
+    static LogSite s_Sites[max_sites];
+    static std::atomic<site_id> s_Count;
+};
+
+template<typename LOGGER_TRAITS> LogSite CSiteRegistryT<LOGGER_TRAITS>::s_Sites[CSiteRegistryT<LOGGER_TRAITS>::max_sites];
+template<typename LOGGER_TRAITS> std::atomic<typename CSiteRegistryT<LOGGER_TRAITS>::site_id> CSiteRegistryT<LOGGER_TRAITS>::s_Count;
+
+using CSiteRegistry = CSiteRegistryT<rtlog::LoggerTraits>;
+
+}  // namespace rtlog
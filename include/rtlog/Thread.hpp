@@ -0,0 +1,96 @@
+/** \file
+ *  CPU affinity, scheduling policy and name of the consumer threads
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <sched.h>
+
+#if defined(__linux__)
+#   include <sys/resource.h>
+#   include <sys/syscall.h>
+#   include <unistd.h>
+#endif
+
+#include <cerrno>
+#include <string>
+#include <vector>
+
+namespace rtlog {
+
+enum class E_SCHED_POLICY
+{
+    /** Keep the policy of the thread creating the consumer */
+    INHERIT,
+    OTHER,
+    BATCH,
+    IDLE,
+    FIFO,
+};
+
+/** Scheduling attributes of a consumer thread, applied by the thread itself before its first dequeue.
+ *  The defaults leave everything as inherited from the creating thread.
+ */
+struct ThreadOptions
+{
+    /** CPUs the thread may run on, empty to inherit the affinity */
+    std::vector<int> cpus;
+    E_SCHED_POLICY policy = E_SCHED_POLICY::INHERIT;
+    /** Nice value, with INHERIT, OTHER and BATCH */
+    int nice = 0;
+    /** Static priority with FIFO, 1 to 99 */
+    int priority = 1;
+    /** Thread name, truncated to 15 chars, empty to inherit */
+    std::string name;
+};
+
+/** Apply options to the calling thread.
+ *  \return 0, or the error number of the first option that could not be applied (e.g. EPERM for FIFO
+ *  without CAP_SYS_NICE); the following ones are applied anyway
+ */
+inline int apply_thread_options(const ThreadOptions& options) noexcept
+{
+    int error(0);
+    auto check = [&error] (int result) { if (result != 0 && error == 0) error = result; };
+#if defined(__linux__)
+    if (!options.name.empty())
+        check(pthread_setname_np(pthread_self(), options.name.substr(0, 15).c_str()));
+
+    if (!options.cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : options.cpus) {
+            if (cpu >= 0 && cpu < CPU_SETSIZE)
+                CPU_SET(cpu, &set);
+        }
+        check(pthread_setaffinity_np(pthread_self(), sizeof(set), &set));
+    }
+
+    if (options.policy != E_SCHED_POLICY::INHERIT) {
+        int policy(SCHED_OTHER);
+        struct sched_param param = {};
+        switch (options.policy) {
+            case E_SCHED_POLICY::BATCH: policy = SCHED_BATCH; break;
+            case E_SCHED_POLICY::IDLE: policy = SCHED_IDLE; break;
+            case E_SCHED_POLICY::FIFO:
+                policy = SCHED_FIFO;
+                param.sched_priority = options.priority;
+                break;
+            default: break;
+        }
+        check(pthread_setschedparam(pthread_self(), policy, &param));
+    }
+
+    // The nice value is per thread on Linux
+    if (options.nice != 0 && options.policy != E_SCHED_POLICY::FIFO && options.policy != E_SCHED_POLICY::IDLE) {
+        if (setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), options.nice) != 0)
+            check(errno);
+    }
+#else
+    (void)options;
+#endif
+    return error;
+}
+
+}  // namespace rtlog
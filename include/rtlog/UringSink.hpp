@@ -0,0 +1,390 @@
+/** \file
+ *  io_uring output sink, the consumer keeps formatting while previous batches are being written
+ */
+
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__NR_io_uring_setup)
+#   include <linux/io_uring.h>
+#   define RTLOG_HAVE_IO_URING 1
+#endif
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "Sink.hpp"
+
+namespace rtlog {
+
+/** io_uring sink, set up with raw system calls.
+ *  Lines are appended to one of a few page aligned buffers registered with the ring. At the end of
+ *  a batch, or when full, the buffer is submitted as a single fixed buffer write at an explicit
+ *  file offset and the consumer moves on to the next buffer without waiting for the completion;
+ *  it only blocks when it wraps around to a buffer still in flight.
+ *  When io_uring is not available (old kernel, seccomp, ...) buffers are written synchronously.
+ */
+class CUringSink
+{
+public:
+    constexpr static bool DIRECT = true;
+    constexpr static std::size_t PAGE_SIZE = 4096;
+    constexpr static unsigned int DEFAULT_BUFFERS = 4;
+    constexpr static std::size_t DEFAULT_BUFFER_SIZE = 256 * 1024;
+
+protected:
+    struct Buffer
+    {
+        char* data = {};
+        std::size_t used = {};
+        /** Submitted length and file offset while in flight */
+        std::size_t length = {};
+        uint64_t offset = {};
+        bool in_flight = {};
+    };
+
+    int m_Fd;
+    std::vector<Buffer> m_Buffers;
+    std::size_t m_Capacity;
+    unsigned int m_Current;
+    /** Next file offset */
+    uint64_t m_Offset;
+    std::atomic<uint64_t> m_Bytes;
+    std::atomic<uint64_t> m_Syscalls;
+
+#if defined(RTLOG_HAVE_IO_URING)
+    int m_RingFd;
+    bool m_Fixed;
+    /** A completion reported the write opcode as not supported, the ring is dropped at the next submit */
+    bool m_Rejected;
+    void* m_SqRing;
+    std::size_t m_SqRingSize;
+    void* m_CqRing;
+    std::size_t m_CqRingSize;
+    struct io_uring_sqe* m_Sqes;
+    std::size_t m_SqesSize;
+    unsigned* m_SqTail;
+    unsigned* m_SqMask;
+    unsigned* m_SqArray;
+    unsigned* m_CqHead;
+    unsigned* m_CqTail;
+    unsigned* m_CqMask;
+    struct io_uring_cqe* m_Cqes;
+
+    bool _setup()
+    {
+        struct io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        // At most one write in flight per buffer
+        m_RingFd = static_cast<int>(syscall(__NR_io_uring_setup, static_cast<unsigned>(m_Buffers.size()), &params));
+        if (m_RingFd < 0)
+            return false;
+
+        m_SqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        m_CqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        if (params.features & IORING_FEAT_SINGLE_MMAP)
+            m_SqRingSize = m_CqRingSize = m_SqRingSize > m_CqRingSize ? m_SqRingSize : m_CqRingSize;
+        m_SqRing = mmap(nullptr, m_SqRingSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, m_RingFd, IORING_OFF_SQ_RING);
+        if (m_SqRing == MAP_FAILED)
+            return _teardown();
+        if (params.features & IORING_FEAT_SINGLE_MMAP)
+            m_CqRing = m_SqRing;
+        else {
+            m_CqRing = mmap(nullptr, m_CqRingSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, m_RingFd, IORING_OFF_CQ_RING);
+            if (m_CqRing == MAP_FAILED)
+                return _teardown();
+        }
+        m_SqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+        void* sqes(mmap(nullptr, m_SqesSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, m_RingFd, IORING_OFF_SQES));
+        if (sqes == MAP_FAILED)
+            return _teardown();
+        m_Sqes = static_cast<struct io_uring_sqe*>(sqes);
+
+        char* sq(static_cast<char*>(m_SqRing));
+        char* cq(static_cast<char*>(m_CqRing));
+        m_SqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        m_SqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        m_SqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        m_CqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        m_CqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        m_CqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        m_Cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        // Registered buffers save the page pinning on each write, plain writes otherwise
+        std::vector<struct iovec> iov(m_Buffers.size());
+        for (std::size_t i = {}; i < m_Buffers.size(); i++)
+            iov[i] = { m_Buffers[i].data, m_Capacity };
+        m_Fixed = syscall(__NR_io_uring_register, m_RingFd, IORING_REGISTER_BUFFERS, iov.data(), static_cast<unsigned>(iov.size())) == 0;
+        // IORING_OP_WRITE_FIXED is as old as io_uring, IORING_OP_WRITE came later
+        if (!m_Fixed && !_supported(IORING_OP_WRITE))
+            return _teardown();
+        return true;
+    }
+
+    /** Ask the kernel if op is supported, kernels without IORING_REGISTER_PROBE lack IORING_OP_WRITE as well */
+    bool _supported(unsigned op)
+    {
+#if defined(IO_URING_OP_SUPPORTED)
+        constexpr unsigned MAX_OPS = 256;
+        // struct io_uring_probe header followed by its ops array
+        std::vector<struct io_uring_probe_op> storage(MAX_OPS + sizeof(struct io_uring_probe) / sizeof(struct io_uring_probe_op));
+        struct io_uring_probe* probe(reinterpret_cast<struct io_uring_probe*>(storage.data()));
+        if (syscall(__NR_io_uring_register, m_RingFd, IORING_REGISTER_PROBE, probe, MAX_OPS) < 0)
+            return false;
+        return op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+#else
+        return false;
+#endif
+    }
+
+    bool _teardown()
+    {
+        if (m_Sqes)
+            munmap(m_Sqes, m_SqesSize);
+        if (m_CqRing && m_CqRing != MAP_FAILED && m_CqRing != m_SqRing)
+            munmap(m_CqRing, m_CqRingSize);
+        if (m_SqRing && m_SqRing != MAP_FAILED)
+            munmap(m_SqRing, m_SqRingSize);
+        if (m_RingFd >= 0)
+            ::close(m_RingFd);
+        m_Sqes = nullptr;
+        m_SqRing = m_CqRing = nullptr;
+        m_RingFd = -1;
+        return false;
+    }
+
+    /** Wait for the writes in flight and switch to the synchronous fallback */
+    void _stop_ring()
+    {
+        for (auto& b : m_Buffers)
+            while (b.in_flight)
+                _reap(true);
+        _teardown();
+    }
+
+    inline int _enter(unsigned to_submit, unsigned min_complete, unsigned flags)
+    {
+        m_Syscalls.store(m_Syscalls.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return static_cast<int>(syscall(__NR_io_uring_enter, m_RingFd, to_submit, min_complete, flags, nullptr, 0));
+    }
+
+    /** Process the available completions, waiting for at least one if wait is set */
+    void _reap(bool wait)
+    {
+        unsigned head(__atomic_load_n(m_CqHead, __ATOMIC_RELAXED));
+        if (wait && head == __atomic_load_n(m_CqTail, __ATOMIC_ACQUIRE))
+            _enter(0, 1, IORING_ENTER_GETEVENTS);
+
+        const unsigned tail(__atomic_load_n(m_CqTail, __ATOMIC_ACQUIRE));
+        for (; head != tail; head++) {
+            const struct io_uring_cqe& cqe(m_Cqes[head & *m_CqMask]);
+            Buffer& b(m_Buffers[cqe.user_data]);
+            const std::size_t done(cqe.res > 0 ? static_cast<std::size_t>(cqe.res) : 0);
+            m_Bytes.store(m_Bytes.load(std::memory_order_relaxed) + done, std::memory_order_relaxed);
+            if (cqe.res == -EINVAL || cqe.res == -EOPNOTSUPP)
+                m_Rejected = true;
+            // Short or failed write, finish synchronously
+            if (done < b.length)
+                _pwrite(b.data + done, b.length - done, b.offset + done);
+            b.in_flight = false;
+            b.used = 0;
+        }
+        __atomic_store_n(m_CqHead, head, __ATOMIC_RELEASE);
+    }
+
+    /** Queue the write of buffer index, false if it could not be submitted */
+    bool _submit_ring(unsigned int index)
+    {
+        Buffer& b(m_Buffers[index]);
+        const unsigned tail(*m_SqTail);
+        const unsigned slot(tail & *m_SqMask);
+        struct io_uring_sqe& sqe(m_Sqes[slot]);
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = m_Fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+        sqe.fd = m_Fd;
+        sqe.addr = reinterpret_cast<uint64_t>(b.data);
+        sqe.len = static_cast<uint32_t>(b.used);
+        sqe.off = m_Offset;
+        sqe.buf_index = static_cast<uint16_t>(index);
+        sqe.user_data = index;
+        m_SqArray[slot] = slot;
+        __atomic_store_n(m_SqTail, tail + 1, __ATOMIC_RELEASE);
+
+        int ret;
+        while ((ret = _enter(1, 0, 0)) < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY))
+            _reap(false);
+        if (ret < 1) {
+            // Not consumed by the kernel, take it back
+            __atomic_store_n(m_SqTail, tail, __ATOMIC_RELEASE);
+            return false;
+        }
+        b.length = b.used;
+        b.offset = m_Offset;
+        b.in_flight = true;
+        return true;
+    }
+#endif
+
+    void _pwrite(const char* data, std::size_t size, uint64_t offset)
+    {
+        while (size > 0) {
+            const ssize_t written(::pwrite(m_Fd, data, size, static_cast<off_t>(offset)));
+            m_Syscalls.store(m_Syscalls.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            if (written < 0) {
+                if (errno == EINTR)
+                    continue;
+                return;  // Errors drop the data
+            }
+            m_Bytes.store(m_Bytes.load(std::memory_order_relaxed) + written, std::memory_order_relaxed);
+            data += written;
+            size -= written;
+            offset += written;
+        }
+    }
+
+    /** Hand the current buffer to the kernel and move to the next free one */
+    void _submit()
+    {
+        Buffer& b(m_Buffers[m_Current]);
+        const std::size_t used(b.used);
+        if (used == 0)
+            return;
+#if defined(RTLOG_HAVE_IO_URING)
+        if (m_RingFd >= 0 && m_Rejected)
+            _stop_ring();
+        if (m_RingFd < 0 || !_submit_ring(m_Current))
+#endif
+        {
+            _pwrite(b.data, used, m_Offset);
+            b.used = 0;
+        }
+        m_Offset += used;
+        m_Current = (m_Current + 1) % m_Buffers.size();
+#if defined(RTLOG_HAVE_IO_URING)
+        while (m_Buffers[m_Current].in_flight)
+            _reap(true);
+#endif
+    }
+
+public:
+    explicit CUringSink(
+        const std::string& filename,
+        unsigned int buffers = DEFAULT_BUFFERS, std::size_t buffer_size = DEFAULT_BUFFER_SIZE
+    ) :
+        m_Fd(::open(filename.c_str(), O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0644)),
+        m_Buffers(buffers ? buffers : 1),
+        m_Capacity((buffer_size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1)),
+        m_Current(0), m_Offset(0), m_Bytes(0), m_Syscalls(0)
+#if defined(RTLOG_HAVE_IO_URING)
+        , m_RingFd(-1), m_Fixed(false), m_Rejected(false),
+        m_SqRing(nullptr), m_SqRingSize(0), m_CqRing(nullptr), m_CqRingSize(0),
+        m_Sqes(nullptr), m_SqesSize(0)
+#endif
+    {
+        for (auto& b : m_Buffers) {
+            void* data;
+            b.data = posix_memalign(&data, PAGE_SIZE, m_Capacity) == 0 ? static_cast<char*>(data) : nullptr;
+            if (!b.data)
+                m_Capacity = 0;  // Unbuffered
+        }
+#if defined(RTLOG_HAVE_IO_URING)
+        // Like std::ofstream, a sink that failed to open silently discards the output
+        if (m_Fd >= 0 && m_Capacity)
+            _setup();
+#endif
+    }
+    CUringSink(const CUringSink&) = delete;
+    CUringSink& operator=(const CUringSink&) = delete;
+    ~CUringSink()
+    {
+        close();
+        for (auto& b : m_Buffers)
+            std::free(b.data);
+    }
+
+    inline void write(const char* data, std::size_t size)
+    {
+        Buffer* b(&m_Buffers[m_Current]);
+        if (size > m_Capacity - b->used) {
+            _submit();
+            b = &m_Buffers[m_Current];
+            if (size > m_Capacity) {
+                // Larger than a whole buffer
+                _pwrite(data, size, m_Offset);
+                m_Offset += size;
+                return;
+            }
+        }
+        std::memcpy(b->data + b->used, data, size);
+        b->used += size;
+    }
+
+    /** Submits the buffer and moves to the next one when the room left is less than size */
+    inline char* reserve(std::size_t size)
+    {
+        if (size > m_Capacity - m_Buffers[m_Current].used) {
+            _submit();
+            if (size > m_Capacity)
+                return nullptr;
+        }
+        return m_Buffers[m_Current].data + m_Buffers[m_Current].used;
+    }
+    inline void commit(std::size_t size) { m_Buffers[m_Current].used += size; }
+
+    /** Submit the batch, don't wait for it */
+    void flush()
+    {
+        _submit();
+#if defined(RTLOG_HAVE_IO_URING)
+        if (m_RingFd >= 0)
+            _reap(false);
+#endif
+    }
+
+    void close()
+    {
+        if (m_Fd < 0)
+            return;
+        _submit();
+#if defined(RTLOG_HAVE_IO_URING)
+        if (m_RingFd >= 0)
+            _stop_ring();
+#endif
+        ::close(m_Fd);
+        m_Fd = -1;
+    }
+
+    bool is_open() const { return m_Fd >= 0; }
+
+    /** True if writes go through io_uring, false if using the synchronous fallback
+     *  (io_uring or its write opcode not available, or writes rejected by the kernel)
+     */
+    bool is_async() const
+    {
+#if defined(RTLOG_HAVE_IO_URING)
+        return m_RingFd >= 0;
+#else
+        return false;
+#endif
+    }
+
+    SinkStats getStats() const
+    {
+        SinkStats stats;
+        stats.bytes = m_Bytes.load(std::memory_order_relaxed);
+        stats.syscalls = m_Syscalls.load(std::memory_order_relaxed);
+        return stats;
+    }
+};
+
+}  // namespace rtlog
@@ -4,10 +4,20 @@
 
 #pragma once
 
+#include <memory>
+#include <mutex>
+#include <vector>
+
 #include "Argument.hpp"
 #include "Consumer.hpp"
 #include "Formatter.hpp"
 #include "Levels.hpp"
+#include "Overflow.hpp"
+#include "Queue.hpp"
+#include "Record.hpp"
+#include "RingQueue.hpp"
+#include "Site.hpp"
+#include "../cached_gettid.hpp"
 #include "../concurrentqueue.h"
 #include "../pthread_gettid_np.hpp"
 #include "../Singleton.hpp"
@@ -25,16 +35,27 @@ namespace rtlog
  * /tmp/nanolog.2.txt
  * etc.
  * log_file_roll_size_mb - mega bytes after which we roll to next log file.
+ * Creates the default CLogger and a CRollingSink consumer, stopped by shutdown() or at exit.
  */
 void initialize(std::string const & log_directory, std::string const & log_file_name, uint32_t log_file_roll_size_mb);
+/** Stop the consumer started by initialize() */
+void shutdown();
 
-template<typename LOGGER_TRAITS, typename QUEUE_TRAITS>
-class CLoggerT : public Singleton<CLoggerT<LOGGER_TRAITS, QUEUE_TRAITS>>
+/** The logger front end, enqueues records on the QUEUE transport:
+ *  moodycamel::ConcurrentQueue or rtlog::CRingQueueT
+ *  OVERFLOW_POLICY decides what happens when the queue is full, see Overflow.hpp
+ */
+template<
+    typename LOGGER_TRAITS, typename QUEUE_TRAITS,
+    template<typename, typename> class QUEUE = moodycamel::ConcurrentQueue,
+    typename OVERFLOW_POLICY = COverflowDropNewest
+>
+class CLoggerT : public Singleton<CLoggerT<LOGGER_TRAITS, QUEUE_TRAITS, QUEUE, OVERFLOW_POLICY>>
 {
     // The minimum number of arguments in case of relative time logged
-    static_assert(LOGGER_TRAITS::PARAM_SIZE > 6);
-    friend class Singleton<CLoggerT<LOGGER_TRAITS, QUEUE_TRAITS>>;
-    friend class std::default_delete<CLoggerT<LOGGER_TRAITS, QUEUE_TRAITS>>;
+    static_assert(LOGGER_TRAITS::PACKED_RECORD || LOGGER_TRAITS::PARAM_SIZE > 6);
+    friend class Singleton<CLoggerT<LOGGER_TRAITS, QUEUE_TRAITS, QUEUE, OVERFLOW_POLICY>>;
+    friend class std::default_delete<CLoggerT<LOGGER_TRAITS, QUEUE_TRAITS, QUEUE, OVERFLOW_POLICY>>;
 
     // We may be using pthread_t as Thread Identifier, so make sure it's a known value
     static_assert(std::is_same<std::thread::native_handle_type, pthread_t>::value);
@@ -45,35 +66,53 @@ public:
     constexpr static std::size_t param_size = LOGGER_TRAITS::PARAM_SIZE;
     constexpr static std::size_t buffer_size = LOGGER_TRAITS::BUFFER_SIZE;
     constexpr static LogLevel DEFAULT_LEVEL = LOGGER_TRAITS::DEFAULT_LEVEL;
+    constexpr static LogLevel MIN_LEVEL = LOGGER_TRAITS::MIN_LEVEL;
 
     typedef typename LOGGER_TRAITS::CHAR_TYPE char_type;
     typedef QUEUE_TRAITS queue_traits;
-    typedef moodycamel::ConcurrentQueue<ArgumentArrayT<LOGGER_TRAITS>, QUEUE_TRAITS> queue_type;
+    typedef RecordT<LOGGER_TRAITS> record_type;
+    typedef CSiteRegistryT<LOGGER_TRAITS> site_registry;
+    typedef CLogQueueT<QUEUE<record_type, QUEUE_TRAITS>> queue_type;
+    typedef OVERFLOW_POLICY overflow_policy;
+    /** Producer tokens and producer side dequeue are specific to moodycamel::ConcurrentQueue */
+    constexpr static bool is_concurrent_queue =
+        std::is_same<typename queue_type::base_queue_type, moodycamel::ConcurrentQueue<record_type, QUEUE_TRAITS>>::value;
+    constexpr static bool use_producer_token = QUEUE_TRAITS::USE_PRODUCER_TOKEN && is_concurrent_queue;
+
+    static_assert(!OVERFLOW_POLICY::EVICTS || is_concurrent_queue, "Overwriting the oldest message requires a multi consumer queue");
 
     /** Set the current logging level */
     void setLevel(LogLevel new_level) { m_LogLevel.store(new_level); }
+    /** Check whether a message at the given level would be enqueued, a single relaxed load */
+    inline bool enabled(LogLevel level) const
+    {
+        return level >= MIN_LEVEL &&
+            static_cast<std::underlying_type<LogLevel>::type>(level) >= m_LogLevel.load(std::memory_order_relaxed);
+    }
     /** Access the underlying message queue */
     queue_type& getQueue() { return m_ArgumentQueue; }
+    /** Messages lost so far because the queue was full */
+    DropCount getDrops() const { return m_ArgumentQueue.drops().get(); }
+    /** Messages of the calling thread dropped so far, evictions excluded */
+    static uint64_t getThreadDrops() { return _thread_drops(); }
 
     /** Enqueue some arguments for later formatting */
     template<typename TID, typename T0, typename... Args>
     inline bool write(TID&& thread_id, LogLevel&& level, const char_type* &&position, T0&& arg0, Args&&... args)
     {
+        if (level < MIN_LEVEL)
+            return true;
         if (static_cast<std::underlying_type<LogLevel>::type>(level) < m_LogLevel.load(std::memory_order_relaxed))
             return true;
 
         // Make sure we have enough room
-        static_assert(sizeof...(Args) < (LOGGER_TRAITS::PARAM_SIZE - 3 - 1));
+        static_assert(record_type::template fits<TID, LogLevel, const char_type*, T0, Args..., _ArrayEndMarker>());
         // Make sure all the POD are 0-initialized
-        ArgumentArrayT<LOGGER_TRAITS> p = {};
+        record_type p = {};
         std::size_t enqueuedArguments = {};
-        _write(p, enqueuedArguments, thread_id);
-        _write(p, enqueuedArguments, level);
-        _write(p, enqueuedArguments, position);
-        _write(p, enqueuedArguments, arg0, args...);
-        _write(p, enqueuedArguments, _ArrayEndMarker());
+        _write(p, enqueuedArguments, thread_id, level, position, arg0, args..., _ArrayEndMarker());
 
-        return (m_ArgumentQueue.try_enqueue(std::move(p)));
+        return _enqueue(std::move(p), level);
     }
 
     /** Save some arguments for later formatting */
@@ -85,47 +124,274 @@ public:
         const char* &&position,
         T0&& arg0, Args&&... args
     )
+    { return _write_timed(time_point, thread_id, level, position, arg0, args...); }
+
+    /** Same with a raw tsc_clock time stamp */
+    template<typename TID, typename T0, typename... Args>
+    inline bool write(
+        tsc_clock::time_point&& time_point,
+        TID&& thread_id,
+        LogLevel&& level,
+        const char* &&position,
+        T0&& arg0, Args&&... args
+    )
+    { return _write_timed(time_point, thread_id, level, position, arg0, args...); }
+
+    /** Enqueue the site ID and the raw arguments only, the site is registered on first call.
+     *  site is a callable returning the LogSite of this log statement, unique for each statement.
+     */
+    template<typename SITE, typename TID, typename T0, typename... Args>
+    inline bool write_site(SITE&& site, TID&& thread_id, T0&& arg0, Args&&... args)
     {
-        static_assert(sizeof...(Args) <= (LOGGER_TRAITS::PARAM_SIZE - 4 - 1));
-        // Make sure all the POD are 0-initialized
-        ArgumentArrayT<LOGGER_TRAITS> p = {};
-        std::size_t enqueuedArguments = {};
-        _write(p, enqueuedArguments, time_point);
-        _write(p, enqueuedArguments, thread_id);
-        _write(p, enqueuedArguments, level);
-        _write(p, enqueuedArguments, position);
-        _write(p, enqueuedArguments, arg0, args...);
-        _write(p, enqueuedArguments, _ArrayEndMarker());
+        if (site().level < MIN_LEVEL)
+            return true;
+        if (static_cast<std::underlying_type<LogLevel>::type>(site().level) < m_LogLevel.load(std::memory_order_relaxed))
+            return true;
 
-        return (m_ArgumentQueue.try_enqueue(std::move(p)));
+        return _write_site<1>(site, thread_id, arg0, args...);
+    }
+
+    /** Enqueue the site ID and the raw arguments only, the site is registered on first call */
+    template<typename SITE, typename C, typename TID, typename T0, typename... Args>
+    inline bool write_site(SITE&& site, std::chrono::time_point<C>&& time_point, TID&& thread_id, T0&& arg0, Args&&... args)
+    {
+        if (site().level < MIN_LEVEL)
+            return true;
+        if (static_cast<std::underlying_type<LogLevel>::type>(site().level) < m_LogLevel.load(std::memory_order_relaxed))
+            return true;
+
+        return _write_site<2>(site, time_point, thread_id, arg0, args...);
     }
 
 protected:
     CLoggerT(
         LogLevel level = DEFAULT_LEVEL
-    ) : m_LogLevel(level) {}
-    ~CLoggerT() {}
+    ) :
+        m_LogLevel(level),
+        m_ArgumentQueue(QUEUE_TRAITS::MAX_SUBQUEUE_SIZE, QUEUE_TRAITS::MAX_PRODUCERS, QUEUE_TRAITS::MAX_PRODUCERS),
+        m_Generation(++s_Generation),
+        m_Tokens(std::make_shared<CTokenRegistry>())
+    {}
+    ~CLoggerT()
+    {
+        // Threads still holding a token will find the registry empty
+        m_Tokens->clear();
+    }
+
+    /** Owns the producer tokens handed out to threads.
+     *  Shared with the threads so that it's still valid when a thread exits after the logger is gone.
+     */
+    class CTokenRegistry
+    {
+    protected:
+        std::mutex m_Mutex;
+        std::vector<std::unique_ptr<moodycamel::ProducerToken>> m_Tokens;
+
+    public:
+        moodycamel::ProducerToken* acquire(queue_type& queue)
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Tokens.emplace_back(new moodycamel::ProducerToken(queue));
+            return m_Tokens.back().get();
+        }
+        void release(moodycamel::ProducerToken* token)
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            for (auto it = m_Tokens.begin(); it != m_Tokens.end(); ++it) {
+                if (it->get() == token) {
+                    m_Tokens.erase(it);
+                    break;
+                }
+            }
+        }
+        void clear()
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Tokens.clear();
+        }
+    };
+
+    /** Per thread cached token, released when the thread exits */
+    struct ThreadToken
+    {
+        uint64_t generation = {};
+        moodycamel::ProducerToken* token = {};
+        std::weak_ptr<CTokenRegistry> registry;
+
+        void release()
+        {
+            if (auto r = registry.lock())
+                r->release(token);
+            token = nullptr;
+            registry.reset();
+        }
+        ~ThreadToken() { release(); }
+    };
+
+    /** Thread local producer token for this logger, created on first use by each thread */
+    inline moodycamel::ProducerToken& _producer_token()
+    {
+        static thread_local ThreadToken cache;
+        if (cache.generation != m_Generation) {
+            // First message from this thread or a different logger instance
+            cache.release();
+            cache.token = m_Tokens->acquire(m_ArgumentQueue);
+            cache.registry = m_Tokens;
+            cache.generation = m_Generation;
+        }
+        return *cache.token;
+    }
+
+    inline bool _try_enqueue(record_type& p)
+    {
+        if constexpr (use_producer_token)
+            return m_ArgumentQueue.try_enqueue(_producer_token(), std::move(p));
+        else
+            return m_ArgumentQueue.try_enqueue(std::move(p));
+    }
+
+    /** Drop the oldest message of the calling thread, or any when not using tokens */
+    inline bool _evict()
+    {
+        if constexpr (is_concurrent_queue) {
+            record_type evicted;
+            bool ok;
+            if constexpr (use_producer_token)
+                ok = m_ArgumentQueue.try_dequeue_from_producer(_producer_token(), evicted);
+            else
+                ok = m_ArgumentQueue.try_dequeue(evicted);
+            if (ok)
+                m_ArgumentQueue.drops().overwritten();
+            return ok;
+        }
+        else
+            return false;
+    }
+
+    inline bool _enqueue(record_type&& p, LogLevel level)
+    {
+        if (OVERFLOW_POLICY::enqueue([this, &p] () { return _try_enqueue(p); }, [this] () { return _evict(); })) {
+            if constexpr (QUEUE_TRAITS::NOTIFY_CONSUMER)
+                m_ArgumentQueue.notifier().notify();
+            return true;
+        }
+
+        _dropped(level);
+        return false;
+    }
+
+    /** Count a message that did not make it into the queue */
+    inline void _dropped(LogLevel level)
+    {
+        m_ArgumentQueue.drops().dropped(level, details::cached_gettid());
+        _thread_drops()++;
+    }
+
+    template<typename TP, typename TID, typename T0, typename... Args>
+    inline bool _write_timed(TP& time_point, TID& thread_id, LogLevel level, const char* position, T0& arg0, Args&... args)
+    {
+        if (!enabled(level))
+            return true;
+
+        static_assert(record_type::template fits<TP, TID, LogLevel, const char*, T0, Args..., _ArrayEndMarker>());
+        // Make sure all the POD are 0-initialized
+        record_type p = {};
+        std::size_t enqueuedArguments = {};
+        _write(p, enqueuedArguments, time_point, thread_id, level, position, arg0, args..., _ArrayEndMarker());
+
+        return _enqueue(std::move(p), level);
+    }
+
+    static inline uint64_t& _thread_drops()
+    {
+        static thread_local uint64_t drops = 0;
+        return drops;
+    }
 
     template<typename T0, typename... Args>
-    inline bool _write(ArgumentArrayT<LOGGER_TRAITS>& p, std::size_t& queue_pos, T0&& v0, Args&&... args)
+    inline bool _write(record_type& p, std::size_t& queue_pos, T0&& v0, Args&&... args)
     {
-        p[queue_pos++] = v0;
+        p.push(queue_pos, v0, record_type::template encoded_size_of<Args...>());
         return _write(p, queue_pos, args...);
     }
     template<typename T0>
-    inline bool _write(ArgumentArrayT<LOGGER_TRAITS>& p, std::size_t& queue_pos, T0&& v0)
+    inline bool _write(record_type& p, std::size_t& queue_pos, T0&& v0)
     {
-        p[queue_pos++] = v0;
+        p.push(queue_pos, v0);
         return true;
     }
 
+    template<std::size_t PREFIX, typename SITE, typename... Values>
+    inline bool _write_site(SITE& site, Values&... values)
+    {
+        static_assert(LOGGER_TRAITS::PACKED_RECORD, "The log site registry requires packed records");
+        static_assert(record_type::template fits_site<Values...>());
+
+        // Registered once, thread safe
+        static const typename site_registry::site_id site_id(
+            site_registry::add(site(), ArgTypeList<Values...>::types, sizeof...(Values), PREFIX)
+        );
+        if (site_id == site_registry::INVALID_SITE) {
+            // Registry full, the statement still gets through with the self describing encoding
+            const LogSite info(site());
+            return _write_unregistered(std::integral_constant<std::size_t, PREFIX>(), info, values...);
+        }
+
+        record_type p = {};
+        std::size_t enqueuedBytes = {};
+        p.push_site(enqueuedBytes, site_id);
+        _write_raw(p, enqueuedBytes, values...);
+
+        return _enqueue(std::move(p), site().level);
+    }
+
+    /** Tagged encoding of a site that could not be registered, level and position taken from the site */
+    template<typename TID, typename... Args>
+    inline bool _write_unregistered(std::integral_constant<std::size_t, 1>, const LogSite& site, TID& thread_id, Args&... args)
+    { return _write_tagged(site.level, thread_id, site.level, site.position, args...); }
+    template<typename TP, typename TID, typename... Args>
+    inline bool _write_unregistered(std::integral_constant<std::size_t, 2>, const LogSite& site, TP& time_point, TID& thread_id, Args&... args)
+    { return _write_tagged(site.level, time_point, thread_id, site.level, site.position, args...); }
+
+    /** Enqueue values with the tagged encoding, counted as dropped if they do not fit a record that way */
+    template<typename... Values>
+    inline bool _write_tagged(LogLevel level, Values&&... values)
+    {
+        if constexpr (record_type::template fits<Values..., _ArrayEndMarker>()) {
+            record_type p = {};
+            std::size_t enqueuedBytes = {};
+            _write(p, enqueuedBytes, values..., _ArrayEndMarker());
+            return _enqueue(std::move(p), level);
+        }
+        else {
+            _dropped(level);
+            return false;
+        }
+    }
+
+    template<typename T0, typename... Args>
+    inline void _write_raw(record_type& p, std::size_t& queue_pos, T0& v0, Args&... args)
+    {
+        p.push_raw(queue_pos, v0, record_type::template raw_size_of<Args...>());
+        _write_raw(p, queue_pos, args...);
+    }
+    inline void _write_raw(record_type& p, std::size_t& queue_pos) {}
+
     /** Current log level */
     std::atomic<std::underlying_type<LogLevel>::type> m_LogLevel;
 
-    /** Each queue element is made of an array of log message pieces */
-    moodycamel::ConcurrentQueue<ArgumentArrayT<LOGGER_TRAITS>, QUEUE_TRAITS> m_ArgumentQueue;
+    /** Each queue element is made of an array of log message pieces or a packed record */
+    queue_type m_ArgumentQueue;
+
+    /** Identifies this logger instance in the thread local token caches */
+    const uint64_t m_Generation;
+    std::shared_ptr<CTokenRegistry> m_Tokens;
+    static std::atomic<uint64_t> s_Generation;
 };
 
+template<typename LOGGER_TRAITS, typename QUEUE_TRAITS, template<typename, typename> class QUEUE, typename OVERFLOW_POLICY>
+std::atomic<uint64_t> CLoggerT<LOGGER_TRAITS, QUEUE_TRAITS, QUEUE, OVERFLOW_POLICY>::s_Generation;
+
 /** Default logger */
 using CLogger = CLoggerT<rtlog::LoggerTraits, rtlog::ConcurrentQueueTraits>;
 
@@ -136,7 +402,13 @@ using CLogger = CLoggerT<rtlog::LoggerTraits, rtlog::ConcurrentQueueTraits>;
 /** pthread_self() is a simple function call implemented in assembler
  *  gettid is a full system call like getpid
  *  pthread_self returns the address of the pthread_t structure, not the real thread ID
+ *  cached gettid is a single syscall for each thread, then a thread local load
+ *  Exactly one of the USE_* selectors must be defined, the Makefile takes it from THREAD_ID
+ *  (e.g. make THREAD_ID=USE_CACHED_GETTID)
  */
+#if (defined(USE_PTHREAD_SELF) + defined(USE_SYS_GETTID) + defined(USE_GETPID) + defined(USE_INTERNAL_GETTID) + defined(USE_CACHED_GETTID)) > 1
+#   error "More than one thread ID source selected"
+#endif
 #if defined(USE_PTHREAD_SELF)
 #   define RTLOG_THREAD_ID() pthread_self()
 #elif defined(USE_SYS_GETTID)
@@ -145,13 +417,33 @@ using CLogger = CLoggerT<rtlog::LoggerTraits, rtlog::ConcurrentQueueTraits>;
 #   define RTLOG_THREAD_ID() getpid()
 #elif defined(USE_INTERNAL_GETTID)
 #   define RTLOG_THREAD_ID() rtlog::details::pthread_gettid_np()
+#elif defined(USE_CACHED_GETTID)
+#   define RTLOG_THREAD_ID() rtlog::details::cached_gettid()
 #endif
 
+/** Static description of the current log statement, a unique type for each expansion */
+#define RTLOG_SITE(LVL)                                                                 \
+    [] () constexpr { return rtlog::LogSite{__FILE__, __LINE__, RTLOG_POSITION(), LVL}; }
+
 #if defined(USE_TIMEPOINT)
 
+/** With USE_TSC_CLOCK only raw ticks are taken, conversion to wall time happens when formatting */
+#if defined(USE_TSC_CLOCK)
+#define RTLOG_NOW() rtlog::tsc_clock::now()
+#else
 #define RTLOG_NOW() std::chrono::high_resolution_clock::now()
+#endif
 
-#define RTLOG(LVL, ...)                                 \
+#if defined(USE_SITE_REGISTRY)
+#define RTLOG_WRITE(LVL, ...)                           \
+    rtlog::CLogger::get().write_site(                   \
+        RTLOG_SITE(LVL),                                \
+        std::move(RTLOG_NOW()),                         \
+        std::move(RTLOG_THREAD_ID()),                   \
+        ##__VA_ARGS__                                   \
+    )
+#else
+#define RTLOG_WRITE(LVL, ...)                           \
     rtlog::CLogger::get().write(                        \
         std::move(RTLOG_NOW()),                         \
         std::move(RTLOG_THREAD_ID()),                   \
@@ -159,20 +451,51 @@ using CLogger = CLoggerT<rtlog::LoggerTraits, rtlog::ConcurrentQueueTraits>;
         std::move(RTLOG_POSITION()),                    \
         ##__VA_ARGS__                                   \
     )
+#endif  // USE_SITE_REGISTRY
 #else
-#define RTLOG(LVL, ...)                                 \
+#if defined(USE_SITE_REGISTRY)
+#define RTLOG_WRITE(LVL, ...)                           \
+    rtlog::CLogger::get().write_site(                   \
+        RTLOG_SITE(LVL),                                \
+        std::move(RTLOG_THREAD_ID()),                   \
+        ##__VA_ARGS__                                   \
+    )
+#else
+#define RTLOG_WRITE(LVL, ...)                           \
     rtlog::CLogger::get().write(                        \
         std::move(RTLOG_THREAD_ID()),                   \
         std::move(LVL),                                 \
         std::move(RTLOG_POSITION()),                    \
         ##__VA_ARGS__                                   \
     )
+#endif  // USE_SITE_REGISTRY
 #endif  // USE_TIMEPOINT
 
+/** Check the level first: clock, thread ID and arguments are evaluated only for enabled messages */
+#define RTLOG(LVL, ...)                                 \
+    (rtlog::CLogger::get().enabled(LVL) ?               \
+        RTLOG_WRITE(LVL, ##__VA_ARGS__) : true)
+
 
+// Below RTLOG_MIN_LEVEL no code nor data is generated and arguments are not evaluated
+#if RTLOG_MIN_LEVEL <= RTLOG_LEVEL_INFO
 #define LOG_INFO(...) \
     do { RTLOG(rtlog::LogLevel::INFO, ##__VA_ARGS__); } while (0);
+#else
+#define LOG_INFO(...) \
+    do { } while (0);
+#endif
+#if RTLOG_MIN_LEVEL <= RTLOG_LEVEL_WARN
 #define LOG_WARN(...) \
     do { RTLOG(rtlog::LogLevel::WARN, ##__VA_ARGS__); } while (0);
+#else
+#define LOG_WARN(...) \
+    do { } while (0);
+#endif
+#if RTLOG_MIN_LEVEL <= RTLOG_LEVEL_CRIT
 #define LOG_CRIT(...) \
     do { RTLOG(rtlog::LogLevel::CRIT, ##__VA_ARGS__); } while (0);
+#else
+#define LOG_CRIT(...) \
+    do { } while (0);
+#endif
@@ -16,7 +16,6 @@
 
 #include <fmt/format.h>
 
-#include <boost/any.hpp>
 #include <boost/preprocessor/stringize.hpp>
 
 #endif  //#__RTLOG_STDAFX_H
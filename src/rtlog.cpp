@@ -8,6 +8,43 @@
 namespace rtlog
 {
 
+namespace
+{
+
+typedef CLogConsumerSingleFileT<LoggerTraits, ConcurrentQueueTraits, moodycamel::ConcurrentQueue, CRollingSink> CRollingConsumer;
+
+/** Function local so that it's destroyed, and the consumer stopped, before the logger */
+std::unique_ptr<CRollingConsumer>& rolling_consumer()
+{
+    static std::unique_ptr<CRollingConsumer> consumer;
+    return consumer;
+}
+
+}  // namespace
+
+void initialize(std::string const & log_directory, std::string const & log_file_name, uint32_t log_file_roll_size_mb)
+{
+    std::string prefix(log_directory);
+    if (!prefix.empty() && prefix.back() != '/')
+        prefix += '/';
+    prefix += log_file_name;
+
+    auto& consumer(rolling_consumer());
+    consumer.reset();
+    auto& logger(CLogger::initialize(LoggerTraits::DEFAULT_LEVEL));
+    consumer.reset(
+        new CRollingConsumer(
+            prefix, logger.getQueue(), CBackoff::sleep(std::chrono::microseconds(1000)),
+            static_cast<uint64_t>(log_file_roll_size_mb) * 1024 * 1024
+        )
+    );
+}
+
+void shutdown()
+{
+    rolling_consumer().reset();
+}
+
 // Make sure the implementation is instantiated
 template
 fmt::BasicWriter<typename LoggerTraits::CHAR_TYPE>& operator<<(fmt::BasicWriter<typename LoggerTraits::CHAR_TYPE>& os, Argument const& arg);